@@ -5,18 +5,199 @@
 #include <userenv.h>
 #include <sddl.h>
 #include <securitybaseapi.h>
+#include <psapi.h>
+#include <dwmapi.h>
+#pragma comment(lib, "dwmapi.lib") // Linked here so every build configuration picks it up
+#include <cstdio>
 
 // Custom window message for sharing follower HWND
 #define WM_REGISTER_FOLLOWER (WM_USER + 1)
 
+// Custom window message telling followers whether the host is visible (wParam = TRUE/FALSE)
+#define WM_HOST_VISIBILITY (WM_USER + 2)
+
+// Custom window message asking the broker to release a parent's followers (wParam = parent HWND)
+#define WM_BROKER_DETACH (WM_USER + 3)
+
+// Custom window message for a parent attaching to the broker (wParam = parent HWND,
+// lParam = follower count | follower threads << 8 | use app container << 16). It is
+// deliberately not let through the message filter, so low IL children cannot send it.
+#define WM_BROKER_ATTACH (WM_USER + 4)
+
+// Custom window message telling a parent that a broker child died (wParam = child process id);
+// the parent drops the followers that went away with it
+#define WM_FOLLOWERS_LOST (WM_USER + 5)
+
+// Timer polling the main window for occlusion
+#define HOST_VISIBILITY_TIMER_ID 1
+const UINT HOST_VISIBILITY_POLL_MS = 500;
+
+// Broker timing
+#define BROKER_HEALTH_TIMER_ID 2
+const UINT BROKER_HEALTH_POLL_MS = 1000;
+const ULONGLONG BROKER_IDLE_EXIT_MS = 30000;  // Exit once no parent has been attached this long
+const ULONGLONG BROKER_CLOSE_GRACE_MS = 2000; // Time a released child gets to exit before termination
+const DWORD BROKER_START_TIMEOUT_MS = 5000;
+const ULONGLONG BROKER_CHILD_START_TIMEOUT_MS = 10000; // Time a child gets to register its followers
+const int BROKER_MAX_RESPAWNS = 3; // Replacements spawned for a parent's crashing child before giving up
+
+// WM_COPYDATA identifier for startup trace spans sent from child to parent
+#define TRACE_COPYDATA_ID 0x54524345 // 'TRCE'
+
+// WM_COPYDATA identifier for registering all followers of a host child in one handshake
+#define FOLLOWERS_COPYDATA_ID 0x464C5752 // 'FLWR'
+
+// Follower hosting limits (bounded by MAXIMUM_WAIT_OBJECTS for process/thread waits)
+const int MAX_FOLLOWERS = 64;
+const int MAX_FOLLOWER_THREADS = 16;
+
 // Global variables
 HWND g_hwndMain = NULL;   // First window (main)
-HWND g_hwndFollower = NULL;  // Second window (follower)
-HWND g_hwndFollowerInChild = NULL; // Follower HWND stored in parent process
-HANDLE g_hChildProcess = NULL; // Handle to child process for cleanup
-wchar_t g_appContainerName[256] = L"WindowFollower.AppContainer.Fixed"; // Fixed app container name
+HWND g_hwndFollowers[MAX_FOLLOWERS] = { 0 };  // Follower windows hosted by this (child) process
+HWND g_hwndFollowersInChild[MAX_FOLLOWERS] = { 0 }; // Follower HWNDs stored in parent process
+int g_followerInChildCount = 0; // Number of followers registered with the parent
+HANDLE g_hChildProcesses[MAX_FOLLOWERS] = { 0 }; // Handles to child processes for cleanup
+int g_childProcessCount = 0; // Number of spawned child processes
+wchar_t g_appContainerName[256] = L"WindowFollower.AppContainer.Fixed"; // App container name (--app_container_name)
+PSID g_appContainerSid = NULL; // App container SID, created once per process
 bool g_VerboseLogs = false;
 
+// Follower hosting (--followers N, --follower_threads K, --process_per_follower)
+int g_followerCount = 1;  // Followers to host (child) or expect (parent)
+int g_followerThreadCount = 0;  // UI threads hosting followers in the child; 0 = main thread only
+bool g_processPerFollower = false; // Spawn one child per follower instead of one host child
+HBRUSH g_followerBrush = NULL; // Render resources shared by all followers in the child
+HPEN g_followerPen = NULL;
+thread_local int t_followerWindowCount = 0; // Live follower windows owned by the current thread
+
+struct FollowerThreadContext
+{
+  HINSTANCE hInstance;
+  int firstIndex;     // First follower index hosted by this thread
+  int stride;         // Distance between follower indices hosted by this thread
+  HANDLE hReadyEvent; // Signaled once this thread's followers are created
+};
+
+FollowerThreadContext g_followerThreadContexts[MAX_FOLLOWER_THREADS];
+HANDLE g_hFollowerThreads[MAX_FOLLOWER_THREADS] = { 0 };
+HWND g_hwndRegistration = NULL; // Window the child registers its followers with (--parent_hwnd)
+bool g_startHidden = false; // Keep followers hidden until a parent adopts them (--start_hidden)
+
+// Session broker (--broker): owns spawning, the warm pool, the app container profile,
+// registration routing and health tracking for every parent that attaches (--use_broker)
+const int MAX_BROKER_PARENTS = 64;
+const int MAX_BROKER_CHILDREN = 128;
+
+struct BrokerAttachRequest
+{
+  HWND parentHwnd;          // Main window the followers are parented to
+  INT32 followerCount;      // Followers the parent wants
+  INT32 followerThreadCount;
+  INT32 useAppContainer;    // Non-zero to host the followers in the app container
+};
+
+enum BrokerChildState
+{
+  BrokerChildStarting, // Spawned, followers not yet registered
+  BrokerChildWarm,     // Pooled, waiting for a parent
+  BrokerChildAssigned, // Followers routed to a parent
+  BrokerChildClosing   // Released, waiting for exit
+};
+
+struct BrokerChild
+{
+  HANDLE hProcess;
+  DWORD processId;
+  BrokerChildState state;
+  HWND parentHwnd;        // Parent the followers belong to; NULL while pooled
+  bool useAppContainer;
+  int followerCount;      // Followers the child hosts
+  int followerThreadCount;
+  int respawnCount;       // Times this child replaced a crashed one for the same parent
+  int registeredCount;    // Followers registered so far
+  HWND followers[MAX_FOLLOWERS];
+  ULONGLONG startDeadline; // GetTickCount64 after which a starting child is considered hung
+  ULONGLONG closeDeadline; // GetTickCount64 after which a closing child is terminated
+};
+
+bool g_isBroker = false;        // --broker
+bool g_useBroker = false;       // --use_broker (parent)
+bool g_exitAfterFollowers = false; // --exit_after_followers (parent, for load tests)
+int g_brokerPoolSize = 2;       // --pool_size: warm single-follower children kept ready
+int g_brokerLoadTestParents = 0; // --broker_load_test N
+HWND g_hwndBroker = NULL;       // Broker window (broker and attached parents)
+bool g_brokerUseAppContainer = false; // Trust level of the warm pool
+BrokerChild g_brokerChildren[MAX_BROKER_CHILDREN];
+int g_brokerChildCount = 0;
+HWND g_brokerParents[MAX_BROKER_PARENTS] = { 0 };
+int g_brokerParentCount = 0;
+ULONGLONG g_brokerIdleSinceTick = 0;
+int g_brokerPoolHits = 0;
+int g_brokerPoolMisses = 0;
+int g_brokerSpawnCount = 0;
+
+// Per-parent results of --broker_load_test, shared with the launcher through a file
+// mapping named after its process id (--load_test_report <launcher pid> <slot>)
+struct LoadTestResult
+{
+  LONGLONG allFollowersQpc;       // QueryPerformanceCounter when the last follower registered
+  LONGLONG timeToAllFollowersQpc; // From the parent's start to that point
+};
+
+DWORD g_loadTestLauncherPid = 0;
+int g_loadTestSlot = -1;
+
+// Parameters for launching a follower host child
+struct ChildLaunchOptions
+{
+  int followers;         // Followers hosted by the child
+  int followerThreads;   // UI threads hosting them; 0 = child's main thread
+  HWND registrationHwnd; // Window the child registers its followers with
+  bool startHidden;      // Keep followers hidden until a parent adopts them
+};
+
+// Run mode selected on the command line; every other option is stored in the
+// globals it configures
+struct CommandLineOptions
+{
+  bool isChild;         // --child
+  bool launchChildAc;   // --launch_child_ac
+  bool benchZOrder;     // --bench_zorder
+};
+
+// Z-order manager: desired stacking of followers in the parent, top first,
+// as indices into g_hwndFollowersInChild
+int g_followerZOrder[MAX_FOLLOWERS] = { 0 };
+int g_followerZOrderCount = 0;
+LONGLONG g_zOrderOpsIssued = 0; // Reorders actually performed
+LONGLONG g_zOrderOpsSaved = 0;  // Reorders avoided compared to re-topping every follower
+
+// Host visibility: in the parent, whether the main window is visible (not minimized,
+// hidden, cloaked or fully covered); in the child, the last state the parent reported
+volatile LONG g_hostVisible = TRUE;
+LONGLONG g_usageSampleQpc = 0;     // Start of the current visibility interval
+ULONGLONG g_usageSampleCpuTime = 0; // Children's CPU time (100ns) at that start
+
+// Startup tracing (enabled with --trace [path])
+struct TraceSpan
+{
+  char name[48];     // Span name (ASCII, escaped by WriteJsonString in the trace JSON)
+  LONGLONG startQpc; // QueryPerformanceCounter at span start
+  LONGLONG endQpc;   // QueryPerformanceCounter at span end
+  DWORD pid;  // Process that recorded the span
+  DWORD tid;  // Thread that recorded the span
+};
+
+// Fixed startup spans plus, per follower, its RegistrationDelivery span and the
+// spans of a single-follower child (process-per-follower mode)
+const int MAX_TRACE_SPANS = 32 + MAX_FOLLOWERS * 8;
+TraceSpan g_traceSpans[MAX_TRACE_SPANS];
+int g_traceSpanCount = 0;
+int g_traceSpansDropped = 0; // Spans lost because the buffer was full
+bool g_TraceEnabled = false;
+LONGLONG g_traceOriginQpc = 0; // WinMain entry (loader time excluded); QPC is system-wide so both processes share this clock
+wchar_t g_tracePath[MAX_PATH] = L"startup_trace.json";
+
 // Window dimensions
 const int WINDOW_WIDTH = 300;
 const int WINDOW_HEIGHT = 200;
@@ -27,33 +208,124 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
 LRESULT CALLBACK FollowerWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 HWND CreateMainWindow(HINSTANCE hInstance);
 HWND CreateFollowerWindow(HINSTANCE hInstance);
-bool CheckChildProcessParam();
-bool CheckLaunchChildAcParam();
-bool SpawnChildProcess(bool useAppContainer);
-bool SpawnChildProcessNormal();
-bool SpawnChildProcessInAppContainer();
+bool CreateFollowerWindows(HINSTANCE hInstance, int firstIndex, int stride);
+DWORD WINAPI FollowerThreadProc(LPVOID param);
+bool StartFollowerThreads(HINSTANCE hInstance);
+BOOL RegisterFollowersWithParent(HWND mainHwnd);
+void GetFollowerTile(const RECT& clientRect, int index, int count, RECT* tile);
+BOOL PositionFollower(HWND hwndMain, int index, UINT flags);
+void RaiseFollower(int index);
+void DropLostFollowers(HWND hwndMain);
+bool IsFromChildProcess(HWND hwnd);
+int ComputeZOrderMoves(const int* currentRanks, int count, bool* keepRank);
+int ApplyFollowerZOrder(HWND hwndMain);
+int RunZOrderBenchmark();
+void ReportFollowerBenchmark();
+void ReportLoadTestResult();
+void GetVisibleFrameBounds(HWND hwnd, RECT* rect);
+BOOL CALLBACK AddMonitorToRegion(HMONITOR hMonitor, HDC hdc, LPRECT clipRect, LPARAM param);
+bool IsHostOccluded(HWND hwndMain);
+void UpdateHostVisibility(HWND hwndMain);
+int QueryChildResourceUsage(SIZE_T* workingSet, SIZE_T* privateBytes, ULONGLONG* cpuTime);
+void AddProcessResourceUsage(HANDLE hProcess, SIZE_T* workingSet, SIZE_T* privateBytes, ULONGLONG* cpuTime);
+void ReportChildResourceUsage(const wchar_t* state);
+bool ParseCommandLine(CommandLineOptions* options);
+LONGLONG QueryTraceClock();
+void RecordTraceSpan(const char* name, LONGLONG startQpc, LONGLONG endQpc);
+void ImportTraceSpans(const void* data, DWORD size);
+void SendTraceSpansToParent(HWND mainHwnd);
+void WriteJsonString(FILE* file, const char* value);
+void WriteTraceFile();
+void BuildChildCommandLine(wchar_t* cmdLine, size_t cmdLineSize, const wchar_t* exePath,
+  const ChildLaunchOptions& options);
+bool SpawnChildProcess(bool useAppContainer, const ChildLaunchOptions& options, HANDLE* phProcess);
+bool SpawnChildProcessNormal(wchar_t* cmdLine, HANDLE* phProcess);
+bool EnsureAppContainerProfile();
+bool SpawnChildProcessInAppContainer(wchar_t* cmdLine, HANDLE* phProcess);
 void CleanupAppContainer();
-void TerminateChildProcess();
-int RunParentProcess(HINSTANCE hInstance, int nCmdShow);
+void TerminateChildProcesses();
+LRESULT CALLBACK BrokerWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+BrokerChild* BrokerSpawnChild(bool useAppContainer, int followers, int followerThreads, HWND parentHwnd);
+void BrokerRouteFollower(HWND followerHwnd);
+void BrokerForwardTraceSpans(HWND followerHwnd, const COPYDATASTRUCT* pCopyData);
+bool IsTrustedBrokerClient(HWND parentHwnd);
+bool BrokerAttachParent(const BrokerAttachRequest& request);
+void BrokerReleaseChild(BrokerChild& child);
+void BrokerDetachParent(HWND parentHwnd);
+void BrokerReplenishPool();
+void BrokerCheckHealth();
+HWND FindOrStartBroker(bool useAppContainer);
+bool BrokerAttach(HWND hwndMain, bool useAppContainer);
+void BrokerDetach(HWND hwndMain);
+int RunParentProcess(HINSTANCE hInstance, int nCmdShow, bool useAppContainer);
 int RunChildProcess(HINSTANCE hInstance);
+int RunBrokerProcess(HINSTANCE hInstance);
+int RunBrokerLoadTest(bool useAppContainer);
+
+// Records a trace span covering the lifetime of the object
+class ScopedTraceSpan
+{
+public:
+  explicit ScopedTraceSpan(const char* name)
+    : m_name(name), m_startQpc(QueryTraceClock())
+  {
+  }
+
+  ~ScopedTraceSpan()
+  {
+    RecordTraceSpan(m_name, m_startQpc, QueryTraceClock());
+  }
+
+private:
+  const char* m_name;
+  LONGLONG m_startQpc;
+};
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
-  // Check if we have a --child parameter (child process)
-  bool isChildProcess = CheckChildProcessParam();
+  g_traceOriginQpc = QueryTraceClock();
+
+  // The command line is parsed once. Tracing must be known before any span can be
+  // recorded, so the argument parsing span is recorded manually once it is.
+  CommandLineOptions options = { 0 };
+  if (!ParseCommandLine(&options))
+  {
+    // Without the arguments we can't tell a child or broker from a parent
+    OutputDebugString(L"Failed to parse the command line\n");
+    return 1;
+  }
+  RecordTraceSpan("ParseArguments", g_traceOriginQpc, QueryTraceClock());
 
-  if (isChildProcess)
+  if (options.isChild)
   {
     // This is the child process - create follower window and register with parent
     return RunChildProcess(hInstance);
   }
+  else if (g_isBroker)
+  {
+    // This is the session broker - spawn and route followers for attached parents
+    g_brokerUseAppContainer = options.launchChildAc;
+    return RunBrokerProcess(hInstance);
+  }
   else
   {
     // This is the parent process - check if we should use app container
-    bool useAppContainer = CheckLaunchChildAcParam();
+    bool useAppContainer = options.launchChildAc;
+
+    // Offline z-order benchmark, no windows involved
+    if (options.benchZOrder)
+    {
+      return RunZOrderBenchmark();
+    }
+
+    // Launches many parents at once, with or without the broker
+    if (g_brokerLoadTestParents > 0)
+    {
+      return RunBrokerLoadTest(useAppContainer);
+    }
 
     // Create main window and spawn child
-    return RunParentProcess(hInstance, nCmdShow);
+    return RunParentProcess(hInstance, nCmdShow, useAppContainer);
   }
 }
 
@@ -93,12 +365,251 @@ HWND CreateFollowerWindow(HINSTANCE hInstance)
   );
 }
 
+void GetFollowerTile(const RECT& clientRect, int index, int count, RECT* tile)
+{
+  // Lay followers out in a near-square grid; a single follower fills the client area
+  int columns = 1;
+  while (columns * columns < count)
+    columns++;
+  int rows = (count + columns - 1) / columns;
+
+  int cellWidth = clientRect.right / columns;
+  int cellHeight = clientRect.bottom / rows;
+
+  // 3px inset on each side of the cell
+  tile->left = (index % columns) * cellWidth + 3;
+  tile->top = (index / columns) * cellHeight + 3;
+  tile->right = tile->left + cellWidth - 6;
+  tile->bottom = tile->top + cellHeight - 6;
+}
+
+BOOL PositionFollower(HWND hwndMain, int index, UINT flags)
+{
+  RECT clientRect;
+  GetClientRect(hwndMain, &clientRect);
+
+  RECT tile;
+  GetFollowerTile(clientRect, index, g_followerCount, &tile);
+
+  // Stacking is left to the z-order manager
+  return SetWindowPos(g_hwndFollowersInChild[index], NULL,
+    tile.left, tile.top,
+    tile.right - tile.left, tile.bottom - tile.top,
+    flags | SWP_NOZORDER);
+}
+
+void RaiseFollower(int index)
+{
+  // Move the follower to the top of the desired stacking order
+  int position = g_followerZOrderCount;
+  for (int i = 0; i < g_followerZOrderCount; i++)
+  {
+    if (g_followerZOrder[i] == index)
+    {
+      position = i;
+      break;
+    }
+  }
+
+  if (position == g_followerZOrderCount)
+  {
+    g_followerZOrderCount++;
+  }
+
+  for (int i = position; i > 0; i--)
+  {
+    g_followerZOrder[i] = g_followerZOrder[i - 1];
+  }
+  g_followerZOrder[0] = index;
+}
+
+bool IsFromChildProcess(HWND hwnd)
+{
+  // Brokered parents only receive these messages from the broker (low IL senders are
+  // filtered), which vouches for the children it spawned
+  if (g_useBroker)
+    return true;
+
+  // Otherwise the window must belong to one of the children this parent spawned
+  DWORD processId = 0;
+  GetWindowThreadProcessId(hwnd, &processId);
+  if (processId == 0)
+    return false;
+
+  for (int i = 0; i < g_childProcessCount; i++)
+  {
+    if (GetProcessId(g_hChildProcesses[i]) == processId)
+      return true;
+  }
+  return false;
+}
+
+void DropLostFollowers(HWND hwndMain)
+{
+  // Compact out followers whose window is gone, remapping the stacking order to the new indices
+  int newIndex[MAX_FOLLOWERS];
+  int kept = 0;
+  for (int i = 0; i < g_followerInChildCount; i++)
+  {
+    if (IsWindow(g_hwndFollowersInChild[i]))
+    {
+      newIndex[i] = kept;
+      g_hwndFollowersInChild[kept++] = g_hwndFollowersInChild[i];
+    }
+    else
+    {
+      newIndex[i] = -1;
+    }
+  }
+
+  int dropped = g_followerInChildCount - kept;
+  if (dropped == 0)
+    return;
+
+  g_followerInChildCount = kept;
+
+  int zOrderCount = 0;
+  for (int i = 0; i < g_followerZOrderCount; i++)
+  {
+    if (newIndex[g_followerZOrder[i]] >= 0)
+    {
+      g_followerZOrder[zOrderCount++] = newIndex[g_followerZOrder[i]];
+    }
+  }
+  g_followerZOrderCount = zOrderCount;
+
+  // The survivors move into the freed tiles
+  for (int i = 0; i < g_followerInChildCount; i++)
+  {
+    PositionFollower(hwndMain, i, SWP_NOACTIVATE);
+  }
+  ApplyFollowerZOrder(hwndMain);
+
+  wchar_t buffer[256];
+  swprintf_s(buffer, L"DropLostFollowers: Dropped %d follower(s), %d remain\n", dropped, g_followerInChildCount);
+  OutputDebugString(buffer);
+}
+
+int ComputeZOrderMoves(const int* currentRanks, int count, bool* keepRank)
+{
+  // currentRanks lists, in current top-to-bottom order, each window's desired rank.
+  // Windows on the longest increasing subsequence of ranks are already in the right
+  // relative order and stay put; every other window needs exactly one reorder.
+  int tailPositions[MAX_FOLLOWERS]; // Position ending the best subsequence of each length
+  int predecessors[MAX_FOLLOWERS];
+  int length = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    // Binary search for the first subsequence whose tail rank is >= this rank
+    int low = 0;
+    int high = length;
+    while (low < high)
+    {
+      int mid = (low + high) / 2;
+      if (currentRanks[tailPositions[mid]] < currentRanks[i])
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+    predecessors[i] = (low > 0) ? tailPositions[low - 1] : -1;
+    tailPositions[low] = i;
+    if (low == length)
+      length++;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    keepRank[currentRanks[i]] = false;
+  }
+  for (int i = (length > 0) ? tailPositions[length - 1] : -1; i >= 0; i = predecessors[i])
+  {
+    keepRank[currentRanks[i]] = true;
+  }
+
+  return count - length;
+}
+
+int ApplyFollowerZOrder(HWND hwndMain)
+{
+  if (g_followerZOrderCount == 0)
+    return 0;
+
+  // Desired rank of each follower index
+  int rankOfFollower[MAX_FOLLOWERS];
+  for (int i = 0; i < MAX_FOLLOWERS; i++)
+  {
+    rankOfFollower[i] = -1;
+  }
+  for (int i = 0; i < g_followerZOrderCount; i++)
+  {
+    rankOfFollower[g_followerZOrder[i]] = i;
+  }
+
+  // Current stacking of the followers among the main window's children
+  int currentRanks[MAX_FOLLOWERS];
+  bool presentRank[MAX_FOLLOWERS] = { false };
+  int count = 0;
+  for (HWND child = GetWindow(hwndMain, GW_CHILD);
+    child != NULL && count < g_followerZOrderCount;
+    child = GetWindow(child, GW_HWNDNEXT))
+  {
+    for (int i = 0; i < g_followerInChildCount; i++)
+    {
+      if (g_hwndFollowersInChild[i] == child && rankOfFollower[i] >= 0)
+      {
+        presentRank[rankOfFollower[i]] = true;
+        currentRanks[count++] = rankOfFollower[i];
+        break;
+      }
+    }
+  }
+
+  bool keepRank[MAX_FOLLOWERS] = { false };
+  int moves = ComputeZOrderMoves(currentRanks, count, keepRank);
+
+  // Walk the desired order top to bottom, inserting each moved follower directly
+  // below its desired predecessor (or at the top for the first one)
+  HWND insertAfter = HWND_TOP;
+  for (int rank = 0; rank < g_followerZOrderCount; rank++)
+  {
+    if (!presentRank[rank])
+      continue;
+
+    HWND follower = g_hwndFollowersInChild[g_followerZOrder[rank]];
+    if (!keepRank[rank])
+    {
+      SetWindowPos(follower, insertAfter, 0, 0, 0, 0,
+        SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
+    }
+    if (!IsWindowVisible(follower))
+    {
+      ShowWindow(follower, SW_SHOWNOACTIVATE);
+    }
+    insertAfter = follower;
+  }
+
+  g_zOrderOpsIssued += moves;
+  g_zOrderOpsSaved += count - moves;
+
+  if (moves > 0)
+  {
+    wchar_t buffer[256];
+    swprintf_s(buffer, L"ApplyFollowerZOrder: %d reorder(s) for %d followers\n", moves, count);
+    OutputDebugString(buffer);
+  }
+
+  return moves;
+}
+
 LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
   switch (uMsg)
   {
   case WM_REGISTER_FOLLOWER:
   {
+    ScopedTraceSpan traceSpan("RegistrationDelivery");
     HWND followerHwnd = (HWND)wParam;
     OutputDebugString(L"MainWindowProc: Received WM_REGISTER_FOLLOWER\n");
 
@@ -106,8 +617,21 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
     swprintf_s(buffer, L"MainWindowProc: Follower HWND: %p\n", followerHwnd);
     OutputDebugString(buffer);
 
+    if (!IsFromChildProcess(followerHwnd))
+    {
+      OutputDebugString(L"MainWindowProc: Ignoring follower not owned by a child process\n");
+      return 0;
+    }
+
+    if (g_followerInChildCount >= MAX_FOLLOWERS)
+    {
+      OutputDebugString(L"MainWindowProc: Follower limit reached, ignoring registration\n");
+      return 0;
+    }
+
     // Store the follower HWND for later use
-    g_hwndFollowerInChild = followerHwnd;
+    int followerIndex = g_followerInChildCount++;
+    g_hwndFollowersInChild[followerIndex] = followerHwnd;
 
     // Modify the follower window to be a child window
     LONG_PTR styles = GetWindowLongPtr(followerHwnd, GWL_STYLE);
@@ -137,10 +661,8 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
       swprintf_s(buffer, L"MainWindowProc: Client rect: %d x %d\n", clientRect.right, clientRect.bottom);
       OutputDebugString(buffer);
 
-      // Reposition the follower window in client coordinates
-      BOOL posResult = SetWindowPos(followerHwnd, HWND_TOP,
-        3, 3,  // Client coordinates offset (simplified)
-        clientRect.right - 6, clientRect.bottom - 6,  // Resize based on client area
+      // Reposition the follower window into its tile in client coordinates
+      BOOL posResult = PositionFollower(hwnd, followerIndex,
         SWP_NOACTIVATE | SWP_SHOWWINDOW | SWP_FRAMECHANGED);
 
       if (posResult)
@@ -152,7 +674,8 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
         UpdateWindow(followerHwnd);
 
         // Ensure it's on top
-        BringWindowToTop(followerHwnd);
+        RaiseFollower(followerIndex);
+        ApplyFollowerZOrder(hwnd);
       }
       else
       {
@@ -167,13 +690,98 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
       swprintf_s(buffer, L"MainWindowProc: SetParent failed with error: %d\n", error);
       OutputDebugString(buffer);
     }
+
+    // Followers registering while the host is hidden start paused
+    if (!g_hostVisible)
+    {
+      PostMessage(followerHwnd, WM_HOST_VISIBILITY, FALSE, 0);
+    }
+
+    if (followerIndex == 0)
+    {
+      RecordTraceSpan("TimeToFirstFollower", g_traceOriginQpc, QueryTraceClock());
+    }
+    if (g_followerInChildCount == g_followerCount)
+    {
+      RecordTraceSpan("TimeToAllFollowers", g_traceOriginQpc, QueryTraceClock());
+      ReportFollowerBenchmark();
+      ReportLoadTestResult();
+
+      if (g_exitAfterFollowers)
+      {
+        PostMessage(hwnd, WM_CLOSE, 0, 0);
+      }
+    }
+  }
+  return 0;
+
+  case WM_FOLLOWERS_LOST:
+  {
+    wchar_t buffer[256];
+    swprintf_s(buffer, L"MainWindowProc: Broker child process %lu died\n", (DWORD)wParam);
+    OutputDebugString(buffer);
+
+    DropLostFollowers(hwnd);
   }
   return 0;
 
+  case WM_COPYDATA:
+  {
+    COPYDATASTRUCT* pCopyData = (COPYDATASTRUCT*)lParam;
+    if (pCopyData == NULL)
+    {
+      return DefWindowProc(hwnd, uMsg, wParam, lParam);
+    }
+
+    // Only children (or, brokered, the broker relaying for them) get this far
+    if (!IsFromChildProcess((HWND)wParam))
+    {
+      OutputDebugString(L"MainWindowProc: Ignoring WM_COPYDATA from unknown sender\n");
+      return FALSE;
+    }
+
+    // Startup trace spans recorded by the child process
+    if (pCopyData->dwData == TRACE_COPYDATA_ID)
+    {
+      ImportTraceSpans(pCopyData->lpData, pCopyData->cbData);
+      return TRUE;
+    }
+
+    // All followers of a host child, registered in one handshake
+    if (pCopyData->dwData == FOLLOWERS_COPYDATA_ID)
+    {
+      if (pCopyData->lpData == NULL || pCopyData->cbData % sizeof(UINT64) != 0)
+      {
+        OutputDebugString(L"MainWindowProc: Ignoring malformed follower registration\n");
+        return FALSE;
+      }
+
+      // Defer the actual SetParent work to posted WM_REGISTER_FOLLOWER messages so
+      // the child's synchronous send returns before we touch its windows
+      const UINT64* followerHandles = (const UINT64*)pCopyData->lpData;
+      int count = (int)(pCopyData->cbData / sizeof(UINT64));
+      for (int i = 0; i < count; i++)
+      {
+        PostMessage(hwnd, WM_REGISTER_FOLLOWER, (WPARAM)(ULONG_PTR)followerHandles[i], 0);
+      }
+
+      wchar_t buffer[256];
+      swprintf_s(buffer, L"MainWindowProc: Received registration for %d followers\n", count);
+      OutputDebugString(buffer);
+      return TRUE;
+    }
+
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+  }
+
   case WM_SIZE:
   {
-    // Resize the follower window when the main window is resized
-    if (g_hwndFollowerInChild != NULL && wParam != SIZE_MINIMIZED)
+    // Minimizing pauses the followers; restoring performs the catch-up layout
+    bool wasVisible = (g_hostVisible != FALSE);
+    UpdateHostVisibility(hwnd);
+
+    // Resize the follower windows when the main window is resized
+    if (g_followerInChildCount > 0 && wParam != SIZE_MINIMIZED && wasVisible && g_hostVisible)
     {
       RECT clientRect;
       GetClientRect(hwnd, &clientRect);
@@ -183,41 +791,38 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
         (long long)wParam, clientRect.right, clientRect.bottom);
       OutputDebugString(buffer);
 
-      // Resize follower to match client area with offsets
-      BOOL result = SetWindowPos(g_hwndFollowerInChild, HWND_TOP,
-        3, 3,  // Position
-        clientRect.right - 6, clientRect.bottom - 6,  // Size based on client area
-        SWP_NOACTIVATE | SWP_SHOWWINDOW);
-
-      if (result)
+      for (int i = 0; i < g_followerInChildCount; i++)
       {
-        // Force redraw of the follower window
-        InvalidateRect(g_hwndFollowerInChild, NULL, TRUE);
-        UpdateWindow(g_hwndFollowerInChild);
-
-        swprintf_s(buffer, L"MainWindowProc: Follower window resized to %d x %d\n",
-          clientRect.right - 6, clientRect.bottom - 6);
-        OutputDebugString(buffer);
-      }
-      else
-      {
-        DWORD error = GetLastError();
-        swprintf_s(buffer, L"MainWindowProc: SetWindowPos in WM_SIZE failed with error: %d\n", error);
-        OutputDebugString(buffer);
+        // Resize follower to match its tile of the client area
+        BOOL result = PositionFollower(hwnd, i, SWP_NOACTIVATE | SWP_SHOWWINDOW);
+
+        if (result)
+        {
+          // Force redraw of the follower window
+          InvalidateRect(g_hwndFollowersInChild[i], NULL, TRUE);
+          UpdateWindow(g_hwndFollowersInChild[i]);
+        }
+        else
+        {
+          DWORD error = GetLastError();
+          swprintf_s(buffer, L"MainWindowProc: SetWindowPos in WM_SIZE failed with error: %d\n", error);
+          OutputDebugString(buffer);
+        }
       }
+
+      swprintf_s(buffer, L"MainWindowProc: %d follower window(s) resized\n", g_followerInChildCount);
+      OutputDebugString(buffer);
     }
   }
   return 0;
 
   case WM_MOVE:
   {
-    // Ensure follower window stays visible when main window is moved
-    if (g_hwndFollowerInChild != NULL)
+    // Ensure follower windows stay stacked when main window is moved; moving does not
+    // change their tiles, so they have nothing to repaint
+    if (g_followerInChildCount > 0 && g_hostVisible)
     {
-      SetWindowPos(g_hwndFollowerInChild, HWND_TOP, 0, 0, 0, 0,
-        SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE | SWP_SHOWWINDOW);
-      InvalidateRect(g_hwndFollowerInChild, NULL, TRUE);
-      OutputDebugString(L"MainWindowProc: Main window moved, refreshing follower\n");
+      ApplyFollowerZOrder(hwnd);
     }
   }
   return 0;
@@ -226,14 +831,19 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
   {
     // Only handle z-order changes here, not size changes
     WINDOWPOS* pWinPos = (WINDOWPOS*)lParam;
-    if (g_hwndFollowerInChild != NULL && !(pWinPos->flags & SWP_NOSIZE))
+    if (g_followerInChildCount > 0 && g_hostVisible && !(pWinPos->flags & SWP_NOSIZE))
     {
-      // Window was resized, ensure follower stays visible
-      SetWindowPos(g_hwndFollowerInChild, HWND_TOP, 0, 0, 0, 0,
-        SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE | SWP_SHOWWINDOW);
-      RedrawWindow(g_hwndFollowerInChild, NULL, NULL,
-        RDW_INVALIDATE | RDW_UPDATENOW | RDW_ALLCHILDREN);
-      OutputDebugString(L"MainWindowProc: Window position changed, refreshing follower\n");
+      // Window was resized, ensure followers stay visible; the resized tiles are
+      // repainted by WM_SIZE, so only a restack needs a redraw here
+      if (ApplyFollowerZOrder(hwnd) > 0)
+      {
+        for (int i = 0; i < g_followerInChildCount; i++)
+        {
+          RedrawWindow(g_hwndFollowersInChild[i], NULL, NULL,
+            RDW_INVALIDATE | RDW_UPDATENOW | RDW_ALLCHILDREN);
+        }
+        OutputDebugString(L"MainWindowProc: Window position changed, refreshing followers\n");
+      }
     }
     // Let DefWindowProc handle it
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
@@ -255,19 +865,33 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
 
     EndPaint(hwnd, &ps);
 
-    // Ensure follower window stays visible and on top after painting
-    if (g_hwndFollowerInChild != NULL)
+    // Ensure follower windows stay visible and on top after painting; they only
+    // need repainting if they had to be restacked
+    if (g_hostVisible && ApplyFollowerZOrder(hwnd) > 0)
     {
-      SetWindowPos(g_hwndFollowerInChild, HWND_TOP, 0, 0, 0, 0,
-        SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE | SWP_SHOWWINDOW);
-      InvalidateRect(g_hwndFollowerInChild, NULL, TRUE);
+      for (int i = 0; i < g_followerInChildCount; i++)
+      {
+        InvalidateRect(g_hwndFollowersInChild[i], NULL, TRUE);
+      }
     }
   }
   return 0;
 
+  case WM_TIMER:
+    if (wParam == HOST_VISIBILITY_TIMER_ID)
+    {
+      UpdateHostVisibility(hwnd);
+      return 0;
+    }
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+
   case WM_DESTROY:
-    // Terminate the child process before closing
-    TerminateChildProcess();
+    KillTimer(hwnd, HOST_VISIBILITY_TIMER_ID);
+    ReportChildResourceUsage(g_hostVisible ? L"visible" : L"hidden");
+
+    // Terminate the child processes before closing (the broker releases brokered ones)
+    BrokerDetach(hwnd);
+    TerminateChildProcesses();
     PostQuitMessage(0);
     return 0;
 
@@ -280,8 +904,41 @@ LRESULT CALLBACK FollowerWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
 {
   switch (uMsg)
   {
+  case WM_CREATE:
+    // Track followers per thread so each UI thread quits with its last follower
+    t_followerWindowCount++;
+    return 0;
+
+  case WM_HOST_VISIBILITY:
+  {
+    bool visible = (wParam != 0);
+    LONG wasVisible = InterlockedExchange(&g_hostVisible, visible ? TRUE : FALSE);
+
+    if (!visible && wasVisible)
+    {
+      // First follower to learn the host is hidden trims the whole process
+      SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+      OutputDebugString(L"FollowerWindowProc: Host hidden, rendering paused and working set trimmed\n");
+    }
+    else if (visible && !wasVisible)
+    {
+      OutputDebugString(L"FollowerWindowProc: Host visible, resuming rendering\n");
+    }
+
+    // Single catch-up paint once the host is visible again
+    if (visible)
+    {
+      InvalidateRect(hwnd, NULL, TRUE);
+    }
+  }
+  return 0;
+
   case WM_ERASEBKGND:
   {
+    // Nothing is shown while the host is hidden
+    if (!g_hostVisible)
+      return 1;
+
     // Explicitly erase background
     HDC hdc = (HDC)wParam;
     RECT rect;
@@ -295,23 +952,26 @@ LRESULT CALLBACK FollowerWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
     PAINTSTRUCT ps;
     HDC hdc = BeginPaint(hwnd, &ps);
 
+    // Validate without drawing while the host is hidden
+    if (!g_hostVisible)
+    {
+      EndPaint(hwnd, &ps);
+      return 0;
+    }
+
     // Fill with a solid color to ensure visibility
     RECT rect;
     GetClientRect(hwnd, &rect);
 
-    // Draw a colored background
-    HBRUSH hBrush = CreateSolidBrush(RGB(200, 220, 255)); // Light blue
-    FillRect(hdc, &rect, hBrush);
-    DeleteObject(hBrush);
+    // Draw a colored background (brush and pen are shared by all followers)
+    FillRect(hdc, &rect, g_followerBrush);
 
     // Draw a border
-    HPEN hPen = CreatePen(PS_SOLID, 2, RGB(0, 0, 255)); // Blue border
-    HPEN hOldPen = (HPEN)SelectObject(hdc, hPen);
+    HPEN hOldPen = (HPEN)SelectObject(hdc, g_followerPen);
     HBRUSH hOldBrush = (HBRUSH)SelectObject(hdc, GetStockObject(NULL_BRUSH));
     Rectangle(hdc, 0, 0, rect.right, rect.bottom);
     SelectObject(hdc, hOldPen);
     SelectObject(hdc, hOldBrush);
-    DeleteObject(hPen);
 
     // Draw text
     SetBkMode(hdc, TRANSPARENT);
@@ -330,9 +990,13 @@ LRESULT CALLBACK FollowerWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
     return 0;
 
   case WM_DESTROY:
-    // In child process, if follower window is destroyed, terminate the child process
-    OutputDebugString(L"FollowerWindowProc: Received WM_DESTROY, posting quit message\n");
-    PostQuitMessage(0);
+    // In child process, once the last follower of a thread is destroyed, end that thread's
+    // message loop (for the main thread this terminates the child process)
+    if (--t_followerWindowCount == 0)
+    {
+      OutputDebugString(L"FollowerWindowProc: Received WM_DESTROY, posting quit message\n");
+      PostQuitMessage(0);
+    }
     return 0;
 
   default:
@@ -340,70 +1004,351 @@ LRESULT CALLBACK FollowerWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM
   }
 }
 
-bool CheckChildProcessParam()
+void GetVisibleFrameBounds(HWND hwnd, RECT* rect)
 {
-  int argc;
-  LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+  // GetWindowRect includes the invisible DWM resize borders; the extended
+  // frame bounds are what is actually drawn on screen
+  if (FAILED(DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS, rect, sizeof(*rect))))
+  {
+    GetWindowRect(hwnd, rect);
+  }
+}
 
-  if (argv == NULL)
-    return false;
+BOOL CALLBACK AddMonitorToRegion(HMONITOR hMonitor, HDC hdc, LPRECT clipRect, LPARAM param)
+{
+  // clipRect is the part of the host frame on this monitor
+  HRGN monitorRegion = CreateRectRgnIndirect(clipRect);
+  CombineRgn((HRGN)param, (HRGN)param, monitorRegion, RGN_OR);
+  DeleteObject(monitorRegion);
+  return TRUE;
+}
 
-  bool isChild = false;
-  for (int i = 0; i < argc; i++)
+bool IsHostOccluded(HWND hwndMain)
+{
+  // Start from the on-screen part of the main window's frame (off-screen
+  // areas can never be uncovered), then subtract every visible window above it
+  RECT rect;
+  GetVisibleFrameBounds(hwndMain, &rect);
+  HRGN uncoveredRegion = CreateRectRgn(0, 0, 0, 0);
+  EnumDisplayMonitors(NULL, &rect, AddMonitorToRegion, (LPARAM)uncoveredRegion);
+
+  RECT uncoveredBounds;
+  int regionType = GetRgnBox(uncoveredRegion, &uncoveredBounds);
+
+  for (HWND above = GetWindow(hwndMain, GW_HWNDPREV);
+    above != NULL && regionType != NULLREGION;
+    above = GetWindow(above, GW_HWNDPREV))
   {
-    if (wcscmp(argv[i], L"--child") == 0)
-    {
-      isChild = true;
-      break;
-    }
-    if (wcscmp(argv[i], L"--verbose") == 0)
-    {
-      // Enable verbose output
-      g_VerboseLogs = true;
-    }
+    if (!IsWindowVisible(above) || IsIconic(above))
+      continue;
+
+    // Layered or click-through windows may be see-through; cloaked windows are not shown
+    LONG_PTR exStyles = GetWindowLongPtr(above, GWL_EXSTYLE);
+    if (exStyles & (WS_EX_LAYERED | WS_EX_TRANSPARENT))
+      continue;
+
+    DWORD cloaked = 0;
+    if (SUCCEEDED(DwmGetWindowAttribute(above, DWMWA_CLOAKED, &cloaked, sizeof(cloaked))) && cloaked)
+      continue;
+
+    RECT aboveRect;
+    GetVisibleFrameBounds(above, &aboveRect);
+    HRGN aboveRegion = CreateRectRgnIndirect(&aboveRect);
+    regionType = CombineRgn(uncoveredRegion, uncoveredRegion, aboveRegion, RGN_DIFF);
+    DeleteObject(aboveRegion);
   }
 
-  LocalFree(argv);
-  return isChild;
+  DeleteObject(uncoveredRegion);
+  return regionType == NULLREGION;
 }
 
-bool CheckLaunchChildAcParam()
+void UpdateHostVisibility(HWND hwndMain)
 {
-  int argc;
-  LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
-
-  if (argv == NULL)
-    return false;
+  bool visible = IsWindowVisible(hwndMain) && !IsIconic(hwndMain);
 
-  bool useAppContainer = false;
-  for (int i = 0; i < argc; i++)
+  if (visible)
+  {
+    // A main window on another virtual desktop is cloaked
+    DWORD cloaked = 0;
+    if (SUCCEEDED(DwmGetWindowAttribute(hwndMain, DWMWA_CLOAKED, &cloaked, sizeof(cloaked))) && cloaked)
+      visible = false;
+  }
+
+  if (visible && IsHostOccluded(hwndMain))
+  {
+    visible = false;
+  }
+
+  if (visible == (g_hostVisible != FALSE))
+    return;
+
+  ReportChildResourceUsage(visible ? L"hidden" : L"visible");
+  g_hostVisible = visible ? TRUE : FALSE;
+
+  wchar_t buffer[256];
+  swprintf_s(buffer, L"UpdateHostVisibility: Host %s, notifying %d followers\n",
+    visible ? L"visible" : L"hidden", g_followerInChildCount);
+  OutputDebugString(buffer);
+
+  if (visible)
   {
-    if (wcscmp(argv[i], L"--launch_child_ac") == 0)
+    // Single catch-up layout for everything skipped while hidden; followers
+    // repaint once when they receive the visibility message below
+    ScopedTraceSpan traceSpan("CatchUpLayout");
+    for (int i = 0; i < g_followerInChildCount; i++)
     {
-      useAppContainer = true;
-      break;
+      PositionFollower(hwndMain, i, SWP_NOACTIVATE | SWP_NOREDRAW);
     }
+    ApplyFollowerZOrder(hwndMain);
+
+    // The host may have been resized while hidden; SWP_NOREDRAW left the areas
+    // uncovered by the moved tiles unpainted
+    InvalidateRect(hwndMain, NULL, TRUE);
   }
 
-  LocalFree(argv);
-  return useAppContainer;
+  for (int i = 0; i < g_followerInChildCount; i++)
+  {
+    PostMessage(g_hwndFollowersInChild[i], WM_HOST_VISIBILITY, visible ? TRUE : FALSE, 0);
+  }
 }
 
-bool SpawnChildProcess(bool useAppContainer)
+bool CreateFollowerWindows(HINSTANCE hInstance, int firstIndex, int stride)
 {
-  if (useAppContainer)
+  // Create and show every follower at firstIndex, firstIndex + stride, ...
+  for (int i = firstIndex; i < g_followerCount; i += stride)
   {
-    OutputDebugString(L"Spawning child process in app container\n");
-    return SpawnChildProcessInAppContainer();
+    g_hwndFollowers[i] = CreateFollowerWindow(hInstance);
+    if (!g_hwndFollowers[i])
+    {
+      wchar_t buffer[256];
+      swprintf_s(buffer, L"Child: Failed to create follower window %d\n", i);
+      OutputDebugString(buffer);
+      return false;
+    }
+
+    // Pooled followers stay hidden; the parent shows them when it adopts them
+    if (!g_startHidden)
+    {
+      ShowWindow(g_hwndFollowers[i], SW_SHOW);
+      UpdateWindow(g_hwndFollowers[i]);
+    }
   }
-  else
+
+  return true;
+}
+
+DWORD WINAPI FollowerThreadProc(LPVOID param)
+{
+  FollowerThreadContext* context = (FollowerThreadContext*)param;
+
+  bool created = CreateFollowerWindows(context->hInstance, context->firstIndex, context->stride);
+  SetEvent(context->hReadyEvent);
+
+  if (!created)
+    return 1;
+
+  // Each follower thread pumps messages for its own windows
+  MSG msg;
+  while (GetMessage(&msg, NULL, 0, 0))
   {
-    OutputDebugString(L"Spawning child process normally\n");
-    return SpawnChildProcessNormal();
+    TranslateMessage(&msg);
+    DispatchMessage(&msg);
+  }
+
+  return (DWORD)msg.wParam;
+}
+
+bool StartFollowerThreads(HINSTANCE hInstance)
+{
+  HANDLE readyEvents[MAX_FOLLOWER_THREADS];
+
+  for (int i = 0; i < g_followerThreadCount; i++)
+  {
+    readyEvents[i] = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (readyEvents[i] == NULL)
+    {
+      OutputDebugString(L"Child: Failed to create follower thread ready event\n");
+      return false;
+    }
+
+    // Followers are distributed round-robin across the thread pool
+    FollowerThreadContext& context = g_followerThreadContexts[i];
+    context.hInstance = hInstance;
+    context.firstIndex = i;
+    context.stride = g_followerThreadCount;
+    context.hReadyEvent = readyEvents[i];
+
+    g_hFollowerThreads[i] = CreateThread(NULL, 0, FollowerThreadProc, &context, 0, NULL);
+    if (g_hFollowerThreads[i] == NULL)
+    {
+      OutputDebugString(L"Child: Failed to create follower thread\n");
+      return false;
+    }
+  }
+
+  WaitForMultipleObjects(g_followerThreadCount, readyEvents, TRUE, INFINITE);
+  for (int i = 0; i < g_followerThreadCount; i++)
+  {
+    CloseHandle(readyEvents[i]);
+  }
+
+  for (int i = 0; i < g_followerCount; i++)
+  {
+    if (g_hwndFollowers[i] == NULL)
+      return false;
+  }
+
+  return true;
+}
+
+BOOL RegisterFollowersWithParent(HWND mainHwnd)
+{
+  // HWNDs are sent as 64-bit values so 32- and 64-bit builds agree on the layout
+  UINT64 followerHandles[MAX_FOLLOWERS];
+  for (int i = 0; i < g_followerCount; i++)
+  {
+    followerHandles[i] = (UINT64)(ULONG_PTR)g_hwndFollowers[i];
+  }
+
+  COPYDATASTRUCT copyData = { 0 };
+  copyData.dwData = FOLLOWERS_COPYDATA_ID;
+  copyData.cbData = (DWORD)(g_followerCount * sizeof(UINT64));
+  copyData.lpData = followerHandles;
+
+  // The parent only queues the followers here, so this send does not wait on SetParent
+  DWORD_PTR result = 0;
+  return SendMessageTimeout(mainHwnd, WM_COPYDATA, (WPARAM)g_hwndFollowers[0], (LPARAM)&copyData,
+    SMTO_ABORTIFHUNG, 1000, &result) != 0 && result == TRUE;
+}
+
+bool ParseCommandLine(CommandLineOptions* options)
+{
+  int argc;
+  LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+
+  if (argv == NULL)
+    return false;
+
+  for (int i = 0; i < argc; i++)
+  {
+    if (wcscmp(argv[i], L"--child") == 0)
+    {
+      options->isChild = true;
+    }
+    else if (wcscmp(argv[i], L"--verbose") == 0)
+    {
+      // Enable verbose output
+      g_VerboseLogs = true;
+    }
+    else if (wcscmp(argv[i], L"--launch_child_ac") == 0)
+    {
+      options->launchChildAc = true;
+    }
+    else if (wcscmp(argv[i], L"--app_container_name") == 0 && i + 1 < argc)
+    {
+      // Set by --broker_load_test so concurrent direct-mode parents don't share a profile
+      wcscpy_s(g_appContainerName, argv[++i]);
+    }
+    else if (wcscmp(argv[i], L"--bench_zorder") == 0)
+    {
+      options->benchZOrder = true;
+    }
+    else if (wcscmp(argv[i], L"--trace") == 0)
+    {
+      g_TraceEnabled = true;
+
+      // Optional output path (only meaningful in the parent process)
+      if (i + 1 < argc && wcsncmp(argv[i + 1], L"--", 2) != 0)
+      {
+        wcscpy_s(g_tracePath, argv[++i]);
+      }
+    }
+    else if (wcscmp(argv[i], L"--followers") == 0 && i + 1 < argc)
+    {
+      g_followerCount = _wtoi(argv[++i]);
+    }
+    else if (wcscmp(argv[i], L"--follower_threads") == 0 && i + 1 < argc)
+    {
+      g_followerThreadCount = _wtoi(argv[++i]);
+    }
+    else if (wcscmp(argv[i], L"--process_per_follower") == 0)
+    {
+      g_processPerFollower = true;
+    }
+    else if (wcscmp(argv[i], L"--parent_hwnd") == 0 && i + 1 < argc)
+    {
+      g_hwndRegistration = (HWND)(ULONG_PTR)_wcstoui64(argv[++i], NULL, 10);
+    }
+    else if (wcscmp(argv[i], L"--start_hidden") == 0)
+    {
+      g_startHidden = true;
+    }
+    else if (wcscmp(argv[i], L"--broker") == 0)
+    {
+      g_isBroker = true;
+    }
+    else if (wcscmp(argv[i], L"--use_broker") == 0)
+    {
+      g_useBroker = true;
+    }
+    else if (wcscmp(argv[i], L"--exit_after_followers") == 0)
+    {
+      g_exitAfterFollowers = true;
+    }
+    else if (wcscmp(argv[i], L"--pool_size") == 0 && i + 1 < argc)
+    {
+      g_brokerPoolSize = _wtoi(argv[++i]);
+    }
+    else if (wcscmp(argv[i], L"--load_test_report") == 0 && i + 2 < argc)
+    {
+      g_loadTestLauncherPid = (DWORD)_wtoi(argv[++i]);
+      g_loadTestSlot = _wtoi(argv[++i]);
+    }
+    else if (wcscmp(argv[i], L"--broker_load_test") == 0 && i + 1 < argc)
+    {
+      g_brokerLoadTestParents = _wtoi(argv[++i]);
+    }
   }
+
+  LocalFree(argv);
+
+  // Clamp to the supported limits (load test parents are waited on together)
+  if (g_followerCount < 1)
+    g_followerCount = 1;
+  if (g_followerCount > MAX_FOLLOWERS)
+    g_followerCount = MAX_FOLLOWERS;
+  if (g_followerThreadCount < 0)
+    g_followerThreadCount = 0;
+  if (g_followerThreadCount > MAX_FOLLOWER_THREADS)
+    g_followerThreadCount = MAX_FOLLOWER_THREADS;
+  if (g_followerThreadCount > g_followerCount)
+    g_followerThreadCount = g_followerCount;
+  if (g_brokerPoolSize < 0)
+    g_brokerPoolSize = 0;
+  if (g_brokerPoolSize > MAX_FOLLOWERS)
+    g_brokerPoolSize = MAX_FOLLOWERS;
+  if (g_brokerLoadTestParents < 0)
+    g_brokerLoadTestParents = 0;
+  if (g_brokerLoadTestParents > MAX_BROKER_PARENTS)
+    g_brokerLoadTestParents = MAX_BROKER_PARENTS;
+
+  return true;
+}
+
+void BuildChildCommandLine(wchar_t* cmdLine, size_t cmdLineSize, const wchar_t* exePath,
+  const ChildLaunchOptions& options)
+{
+  // The registration window is passed explicitly so the child does not have to
+  // search for it by class name
+  swprintf_s(cmdLine, cmdLineSize,
+    L"\"%s\" --child --followers %d --follower_threads %d --parent_hwnd %llu%s%s",
+    exePath, options.followers, options.followerThreads,
+    (unsigned long long)(ULONG_PTR)options.registrationHwnd,
+    options.startHidden ? L" --start_hidden" : L"",
+    g_TraceEnabled ? L" --trace" : L"");
 }
 
-bool SpawnChildProcessNormal()
+bool SpawnChildProcess(bool useAppContainer, const ChildLaunchOptions& options, HANDLE* phProcess)
 {
   wchar_t exePath[MAX_PATH];
   if (GetModuleFileName(NULL, exePath, MAX_PATH) == 0)
@@ -413,8 +1358,22 @@ bool SpawnChildProcessNormal()
   }
 
   wchar_t cmdLine[512];
-  swprintf_s(cmdLine, L"\"%s\" --child", exePath);
+  BuildChildCommandLine(cmdLine, _countof(cmdLine), exePath, options);
+
+  if (useAppContainer)
+  {
+    OutputDebugString(L"Spawning child process in app container\n");
+    return SpawnChildProcessInAppContainer(cmdLine, phProcess);
+  }
+  else
+  {
+    OutputDebugString(L"Spawning child process normally\n");
+    return SpawnChildProcessNormal(cmdLine, phProcess);
+  }
+}
 
+bool SpawnChildProcessNormal(wchar_t* cmdLine, HANDLE* phProcess)
+{
   STARTUPINFO si = { 0 };
   si.cb = sizeof(si);
   PROCESS_INFORMATION pi = { 0 };
@@ -428,34 +1387,19 @@ bool SpawnChildProcessNormal()
     return false;
   }
 
-  // Store the child process handle for later cleanup
-  g_hChildProcess = pi.hProcess;
+  // Hand the child process handle to the caller for later cleanup
+  *phProcess = pi.hProcess;
   CloseHandle(pi.hThread);
 
   OutputDebugString(L"Child process spawned successfully (normal)\n");
   return true;
 }
 
-bool SpawnChildProcessInAppContainer()
+bool EnsureAppContainerProfile()
 {
-  wchar_t exePath[MAX_PATH];
-  if (GetModuleFileName(NULL, exePath, MAX_PATH) == 0)
-  {
-    OutputDebugString(L"Failed to get executable path\n");
-    return false;
-  }
-
-  wchar_t cmdLine[512];
-  swprintf_s(cmdLine, L"\"%s\" --child", exePath);
-
-  // Create an app container profile for low trust execution
-  PSID appContainerSid = NULL;
-  SECURITY_CAPABILITIES securityCapabilities = { 0 };
-  STARTUPINFOEX siEx = { 0 };
-  PROCESS_INFORMATION pi = { 0 };
-  SIZE_T attributeListSize = 0;
-  LPPROC_THREAD_ATTRIBUTE_LIST pAttributeList = NULL;
-  bool success = false;
+  // The profile and its SID are set up once per process and reused for every spawn
+  if (g_appContainerSid != NULL)
+    return true;
 
   // Create app container profile using fixed name
   HRESULT hr = CreateAppContainerProfile(
@@ -464,7 +1408,7 @@ bool SpawnChildProcessInAppContainer()
     L"Low trust container for follower window", // Description
     NULL,     // Capabilities (none for low trust)
     0,    // Capability count
-    &appContainerSid        // App container SID
+    &g_appContainerSid        // App container SID
   );
 
   if (FAILED(hr) && hr != HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS))
@@ -472,22 +1416,41 @@ bool SpawnChildProcessInAppContainer()
     wchar_t errorMsg[256];
     swprintf_s(errorMsg, L"Failed to create app container profile. HRESULT: 0x%08X", hr);
     OutputDebugString(errorMsg);
-    goto cleanup;
+    return false;
   }
 
   // If profile already exists, get the SID
   if (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS))
   {
-    hr = DeriveAppContainerSidFromAppContainerName(g_appContainerName, &appContainerSid);
+    hr = DeriveAppContainerSidFromAppContainerName(g_appContainerName, &g_appContainerSid);
     if (FAILED(hr))
     {
       OutputDebugString(L"Failed to derive app container SID\n");
-      goto cleanup;
+      g_appContainerSid = NULL;
+      return false;
     }
   }
 
+  return true;
+}
+
+bool SpawnChildProcessInAppContainer(wchar_t* cmdLine, HANDLE* phProcess)
+{
+  SECURITY_CAPABILITIES securityCapabilities = { 0 };
+  STARTUPINFOEX siEx = { 0 };
+  PROCESS_INFORMATION pi = { 0 };
+  SIZE_T attributeListSize = 0;
+  LPPROC_THREAD_ATTRIBUTE_LIST pAttributeList = NULL;
+  bool success = false;
+
+  // Create (or reuse) the app container profile for low trust execution
+  if (!EnsureAppContainerProfile())
+  {
+    goto cleanup;
+  }
+
   // Set up security capabilities with UI-related permissions
-  securityCapabilities.AppContainerSid = appContainerSid;
+  securityCapabilities.AppContainerSid = g_appContainerSid;
   securityCapabilities.Capabilities = NULL;// Keep as NULL for maximum restriction
   securityCapabilities.CapabilityCount = 0;  // But test if this works
   securityCapabilities.Reserved = 0;
@@ -550,8 +1513,8 @@ bool SpawnChildProcessInAppContainer()
   OutputDebugString(L"Child process spawned successfully in low trust app container\n");
   success = true;
 
-  // Store the child process handle for later cleanup
-  g_hChildProcess = pi.hProcess;
+  // Hand the child process handle to the caller for later cleanup
+  *phProcess = pi.hProcess;
   CloseHandle(pi.hThread);
 
 cleanup:
@@ -562,16 +1525,17 @@ cleanup:
     HeapFree(GetProcessHeap(), 0, pAttributeList);
   }
 
-  if (appContainerSid)
-  {
-    FreeSid(appContainerSid);
-  }
-
   return success;
 }
 
 void CleanupAppContainer()
 {
+  if (g_appContainerSid != NULL)
+  {
+    FreeSid(g_appContainerSid);
+    g_appContainerSid = NULL;
+  }
+
   // Delete the app container profile when done
   HRESULT hr = DeleteAppContainerProfile(g_appContainerName);
   if (SUCCEEDED(hr))
@@ -590,141 +1554,1242 @@ void CleanupAppContainer()
   }
 }
 
-void TerminateChildProcess()
+void TerminateChildProcesses()
 {
-  if (g_hChildProcess != NULL)
+  if (g_childProcessCount > 0)
   {
-    OutputDebugString(L"Terminating child process...\n");
+    OutputDebugString(L"Terminating child processes...\n");
 
-    // Destroy the follower window first to trigger child process exit
-    if (g_hwndFollowerInChild != NULL)
+    // Destroy the follower windows first to trigger child process exit
+    if (g_followerInChildCount > 0)
     {
-      OutputDebugString(L"Destroying follower window to signal child process...\n");
-      // Post WM_CLOSE to the follower window to let it exit gracefully
-      PostMessage(g_hwndFollowerInChild, WM_CLOSE, 0, 0);
+      OutputDebugString(L"Destroying follower windows to signal child processes...\n");
+      // Post WM_CLOSE to the follower windows to let them exit gracefully
+      for (int i = 0; i < g_followerInChildCount; i++)
+      {
+        PostMessage(g_hwndFollowersInChild[i], WM_CLOSE, 0, 0);
+      }
 
       // Wait a bit for graceful exit
-      DWORD waitResult = WaitForSingleObject(g_hChildProcess, 2000);
+      DWORD waitResult = WaitForMultipleObjects(g_childProcessCount, g_hChildProcesses, TRUE, 2000);
 
       if (waitResult == WAIT_TIMEOUT)
       {
-        // Force terminate if it didn't exit gracefully
-        OutputDebugString(L"Child process didn't exit gracefully, force terminating...\n");
-        TerminateProcess(g_hChildProcess, 0);
-        WaitForSingleObject(g_hChildProcess, 1000);
+        OutputDebugString(L"Child processes didn't exit gracefully, force terminating...\n");
       }
     }
     else
     {
-      // No follower window handle, just force terminate
-      OutputDebugString(L"No follower window handle, force terminating child process...\n");
-      TerminateProcess(g_hChildProcess, 0);
-      WaitForSingleObject(g_hChildProcess, 1000);
+      // No follower window handles, just force terminate
+      OutputDebugString(L"No follower window handles, force terminating child processes...\n");
+    }
+
+    for (int i = 0; i < g_childProcessCount; i++)
+    {
+      // Force terminate any child that is still running
+      if (WaitForSingleObject(g_hChildProcesses[i], 0) == WAIT_TIMEOUT)
+      {
+        TerminateProcess(g_hChildProcesses[i], 0);
+        WaitForSingleObject(g_hChildProcesses[i], 1000);
+      }
+
+      CloseHandle(g_hChildProcesses[i]);
+      g_hChildProcesses[i] = NULL;
     }
 
-    CloseHandle(g_hChildProcess);
-    g_hChildProcess = NULL;
-    g_hwndFollowerInChild = NULL;
-    OutputDebugString(L"Child process terminated and handle closed\n");
+    g_childProcessCount = 0;
+    g_followerInChildCount = 0;
+    g_followerZOrderCount = 0;
+    OutputDebugString(L"Child processes terminated and handles closed\n");
   }
 }
 
-int RunParentProcess(HINSTANCE hInstance, int nCmdShow)
+LONGLONG QueryTraceClock()
 {
-  // Check if we should use app container
-  bool useAppContainer = CheckLaunchChildAcParam();
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+}
 
-  // Register main window class
-  WNDCLASSEX wcMain = { 0 };
-  wcMain.cbSize = sizeof(WNDCLASSEX);
-  wcMain.style = CS_HREDRAW | CS_VREDRAW;
-  wcMain.lpfnWndProc = MainWindowProc;
-  wcMain.hInstance = hInstance;
-  wcMain.hCursor = LoadCursor(NULL, IDC_ARROW);
-  wcMain.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
-  wcMain.lpszClassName = L"MainWindowClass";
+void RecordTraceSpan(const char* name, LONGLONG startQpc, LONGLONG endQpc)
+{
+  if (!g_TraceEnabled)
+    return;
 
-  if (!RegisterClassEx(&wcMain))
+  if (g_traceSpanCount >= MAX_TRACE_SPANS)
   {
-    MessageBox(NULL, L"Failed to register main window class", L"Error", MB_OK);
-    return 1;
+    g_traceSpansDropped++;
+    return;
   }
 
-  // Create main window
-  g_hwndMain = CreateMainWindow(hInstance);
-  if (!g_hwndMain)
+  TraceSpan& span = g_traceSpans[g_traceSpanCount++];
+  strncpy_s(span.name, name, _TRUNCATE);
+  span.startQpc = startQpc;
+  span.endQpc = endQpc;
+  span.pid = GetCurrentProcessId();
+  span.tid = GetCurrentThreadId();
+}
+
+void ImportTraceSpans(const void* data, DWORD size)
+{
+  if (!g_TraceEnabled || data == NULL || size % sizeof(TraceSpan) != 0)
   {
-    MessageBox(NULL, L"Failed to create main window", L"Error", MB_OK);
-    return 1;
+    OutputDebugString(L"ImportTraceSpans: Ignoring malformed trace data\n");
+    return;
   }
 
-  // Allow custom message from low IL process
-  ChangeWindowMessageFilterEx(g_hwndMain, WM_REGISTER_FOLLOWER, MSGFLT_ALLOW, nullptr);
-
-  OutputDebugString(L"Parent: ChangeWindowMessageFilterEx called for WM_REGISTER_FOLLOWER\n");
-
-  // Show main window
-  ShowWindow(g_hwndMain, nCmdShow);
-  UpdateWindow(g_hwndMain);
-
-  // Spawn child process (using app container if requested)
-  if (!SpawnChildProcess(useAppContainer))
+  const TraceSpan* spans = (const TraceSpan*)data;
+  int count = (int)(size / sizeof(TraceSpan));
+  int imported = 0;
+  for (; imported < count && g_traceSpanCount < MAX_TRACE_SPANS; imported++)
   {
-    MessageBox(NULL, L"Failed to spawn child process", L"Error", MB_OK);
-    return 1;
+    g_traceSpans[g_traceSpanCount] = spans[imported];
+    g_traceSpans[g_traceSpanCount].name[sizeof(spans[imported].name) - 1] = '\0';
+    g_traceSpanCount++;
   }
+  g_traceSpansDropped += count - imported;
 
-  // Message loop for parent process (only handles main window)
-  MSG msg;
-  while (GetMessage(&msg, NULL, 0, 0))
+  wchar_t buffer[256];
+  swprintf_s(buffer, L"ImportTraceSpans: Imported %d of %d spans from child\n", imported, count);
+  OutputDebugString(buffer);
+}
+
+void SendTraceSpansToParent(HWND mainHwnd)
+{
+  if (!g_TraceEnabled || g_traceSpanCount == 0)
+    return;
+
+  COPYDATASTRUCT copyData = { 0 };
+  copyData.dwData = TRACE_COPYDATA_ID;
+  copyData.cbData = (DWORD)(g_traceSpanCount * sizeof(TraceSpan));
+  copyData.lpData = g_traceSpans;
+
+  // WM_COPYDATA must be sent synchronously; a timeout keeps a hung parent
+  // from blocking the child's message loop
+  DWORD_PTR result = 0;
+  if (!SendMessageTimeout(mainHwnd, WM_COPYDATA, (WPARAM)g_hwndFollowers[0], (LPARAM)&copyData,
+    SMTO_ABORTIFHUNG, 1000, &result))
   {
-    TranslateMessage(&msg);
-    DispatchMessage(&msg);
+    DWORD error = GetLastError();
+    wchar_t buffer[256];
+    swprintf_s(buffer, L"Child: Sending trace spans failed with error: %d\n", error);
+    OutputDebugString(buffer);
   }
+}
 
-  // Cleanup app container when parent process exits (only if we used it)
-  if (useAppContainer)
+void WriteJsonString(FILE* file, const char* value)
+{
+  fputc('"', file);
+  for (const unsigned char* p = (const unsigned char*)value; *p != '\0'; p++)
   {
-    CleanupAppContainer();
+    if (*p == '"' || *p == '\\')
+    {
+      fputc('\\', file);
+      fputc(*p, file);
+    }
+    else if (*p < 0x20 || *p >= 0x7F)
+    {
+      // Control and non-ASCII bytes; span names are ASCII by convention
+      fprintf(file, "\\u%04x", *p);
+    }
+    else
+    {
+      fputc(*p, file);
+    }
   }
-
-  return (int)msg.wParam;
+  fputc('"', file);
 }
 
-int RunChildProcess(HINSTANCE hInstance)
+void WriteTraceFile()
 {
-  OutputDebugString(L"Child process starting\n");
-
-  // Register follower window class
-  WNDCLASSEX wcFollower = { 0 };
-  wcFollower.cbSize = sizeof(WNDCLASSEX);
-  wcFollower.style = CS_HREDRAW | CS_VREDRAW;
-  wcFollower.lpfnWndProc = FollowerWindowProc;
-  wcFollower.hInstance = hInstance;
-  wcFollower.hCursor = LoadCursor(NULL, IDC_ARROW);
-  wcFollower.hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
-  wcFollower.lpszClassName = L"FollowerWindowClass";
+  if (!g_TraceEnabled)
+    return;
 
-  if (!RegisterClassEx(&wcFollower))
+  FILE* file = NULL;
+  if (_wfopen_s(&file, g_tracePath, L"w") != 0 || file == NULL)
   {
-    MessageBox(NULL, L"Failed to register follower window class", L"Error", MB_OK);
-    return 1;
+    OutputDebugString(L"WriteTraceFile: Failed to open trace file\n");
+    return;
   }
 
-  // Create follower window
-  g_hwndFollower = CreateFollowerWindow(hInstance);
-  if (!g_hwndFollower)
-  {
-    MessageBox(NULL, L"Failed to create follower window", L"Error", MB_OK);
-    return 1;
-  }
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  double usPerTick = 1000000.0 / (double)frequency.QuadPart;
+  DWORD parentPid = GetCurrentProcessId();
 
-  // Show follower window
-  ShowWindow(g_hwndFollower, SW_SHOW);
-  UpdateWindow(g_hwndFollower);
+  // Chrome trace event format; timestamps are microseconds since parent start
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"args\":{\"name\":\"Parent\"}}",
+    parentPid);
 
-  // Find the main window by class name
-  HWND mainHwnd = FindWindow(L"MainWindowClass", NULL);
+  for (int i = 0; i < g_traceSpanCount; i++)
+  {
+    const TraceSpan& span = g_traceSpans[i];
+
+    // Name each child process once, on its first span
+    bool firstSpanOfProcess = (span.pid != parentPid);
+    for (int j = 0; j < i && firstSpanOfProcess; j++)
+    {
+      firstSpanOfProcess = (g_traceSpans[j].pid != span.pid);
+    }
+    if (firstSpanOfProcess)
+    {
+      fprintf(file, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"args\":{\"name\":\"Child\"}}",
+        span.pid);
+    }
+
+    // Child span names arrive from a low trust process, so they are escaped
+    fprintf(file, ",\n{\"name\":");
+    WriteJsonString(file, span.name);
+    fprintf(file, ",\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+      span.pid, span.tid,
+      (double)(span.startQpc - g_traceOriginQpc) * usPerTick,
+      (double)(span.endQpc - span.startQpc) * usPerTick);
+  }
+
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(file);
+
+  wchar_t buffer[MAX_PATH + 64];
+  swprintf_s(buffer, L"WriteTraceFile: Wrote %d spans (%d dropped, buffer full) to %s\n",
+    g_traceSpanCount, g_traceSpansDropped, g_tracePath);
+  OutputDebugString(buffer);
+}
+
+void ReportFollowerBenchmark()
+{
+  // Compare runs with and without --process_per_follower for the same --followers N
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  double elapsedMs = (double)(QueryTraceClock() - g_traceOriginQpc) * 1000.0 / (double)frequency.QuadPart;
+
+  SIZE_T workingSet;
+  SIZE_T privateBytes;
+  ULONGLONG cpuTime;
+  int processCount = QueryChildResourceUsage(&workingSet, &privateBytes, &cpuTime);
+
+  // Pooled broker children may have been running long before this parent, so the
+  // visibility intervals are measured from the moment all followers are in place
+  if (g_useBroker)
+  {
+    g_usageSampleQpc = QueryTraceClock();
+    g_usageSampleCpuTime = cpuTime;
+  }
+
+  wchar_t buffer[512];
+  swprintf_s(buffer,
+    L"FollowerBenchmark: mode=%s followers=%d processes=%d threads=%d "
+    L"time_to_all_followers=%.2f ms child_working_set=%zu KB child_private=%zu KB\n",
+    g_useBroker ? L"broker" : (g_processPerFollower ? L"process_per_follower" : L"host"),
+    g_followerInChildCount, processCount, g_processPerFollower ? 0 : g_followerThreadCount,
+    elapsedMs, workingSet / 1024, privateBytes / 1024);
+  OutputDebugString(buffer);
+}
+
+void ReportLoadTestResult()
+{
+  if (g_loadTestSlot < 0 || g_loadTestSlot >= MAX_BROKER_PARENTS)
+    return;
+
+  wchar_t mappingName[64];
+  swprintf_s(mappingName, L"Local\\XprocHwndTracker.LoadTest.%lu", g_loadTestLauncherPid);
+  HANDLE hMapping = OpenFileMapping(FILE_MAP_WRITE, FALSE, mappingName);
+  if (hMapping == NULL)
+  {
+    OutputDebugString(L"Parent: Load test results mapping not found\n");
+    return;
+  }
+
+  LoadTestResult* results = (LoadTestResult*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, 0);
+  if (results != NULL)
+  {
+    LONGLONG nowQpc = QueryTraceClock();
+    results[g_loadTestSlot].timeToAllFollowersQpc = nowQpc - g_traceOriginQpc;
+    results[g_loadTestSlot].allFollowersQpc = nowQpc;
+    UnmapViewOfFile(results);
+  }
+  CloseHandle(hMapping);
+}
+
+int QueryChildResourceUsage(SIZE_T* workingSet, SIZE_T* privateBytes, ULONGLONG* cpuTime)
+{
+  *workingSet = 0;
+  *privateBytes = 0;
+  *cpuTime = 0;
+
+  if (!g_useBroker)
+  {
+    for (int i = 0; i < g_childProcessCount; i++)
+    {
+      AddProcessResourceUsage(g_hChildProcesses[i], workingSet, privateBytes, cpuTime);
+    }
+    return g_childProcessCount;
+  }
+
+  // Brokered children are owned by the broker; measure the distinct processes
+  // behind the followers this parent adopted
+  DWORD processIds[MAX_FOLLOWERS];
+  int processCount = 0;
+  for (int i = 0; i < g_followerInChildCount; i++)
+  {
+    DWORD processId = 0;
+    GetWindowThreadProcessId(g_hwndFollowersInChild[i], &processId);
+    if (processId == 0)
+      continue;
+
+    bool seen = false;
+    for (int j = 0; j < processCount && !seen; j++)
+    {
+      seen = (processIds[j] == processId);
+    }
+    if (seen)
+      continue;
+
+    HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (hProcess == NULL)
+      continue;
+
+    processIds[processCount++] = processId;
+    AddProcessResourceUsage(hProcess, workingSet, privateBytes, cpuTime);
+    CloseHandle(hProcess);
+  }
+  return processCount;
+}
+
+void AddProcessResourceUsage(HANDLE hProcess, SIZE_T* workingSet, SIZE_T* privateBytes, ULONGLONG* cpuTime)
+{
+  PROCESS_MEMORY_COUNTERS_EX counters = { 0 };
+  counters.cb = sizeof(counters);
+  if (GetProcessMemoryInfo(hProcess, (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters)))
+  {
+    *workingSet += counters.WorkingSetSize;
+    *privateBytes += counters.PrivateUsage;
+  }
+
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if (GetProcessTimes(hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+  {
+    *cpuTime += ((ULONGLONG)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+    *cpuTime += ((ULONGLONG)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+  }
+}
+
+void ReportChildResourceUsage(const wchar_t* state)
+{
+  // Reports the children's CPU use over the visibility interval that just ended
+  // (e.g. idle CPU while occluded) and their memory at its end
+  SIZE_T workingSet;
+  SIZE_T privateBytes;
+  ULONGLONG cpuTime;
+  int processCount = QueryChildResourceUsage(&workingSet, &privateBytes, &cpuTime);
+
+  LONGLONG nowQpc = QueryTraceClock();
+  if (g_usageSampleQpc != 0 && processCount > 0)
+  {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    double intervalMs = (double)(nowQpc - g_usageSampleQpc) * 1000.0 / (double)frequency.QuadPart;
+    double cpuMs = (double)(cpuTime - g_usageSampleCpuTime) / 10000.0;
+
+    wchar_t buffer[512];
+    swprintf_s(buffer,
+      L"HostVisibility: state=%s followers=%d interval=%.0f ms child_cpu=%.1f ms (%.2f%%) "
+      L"child_working_set=%zu KB child_private=%zu KB\n",
+      state, g_followerInChildCount, intervalMs, cpuMs,
+      intervalMs > 0 ? 100.0 * cpuMs / intervalMs : 0.0,
+      workingSet / 1024, privateBytes / 1024);
+    OutputDebugString(buffer);
+  }
+
+  g_usageSampleQpc = nowQpc;
+  g_usageSampleCpuTime = cpuTime;
+}
+
+LRESULT CALLBACK BrokerWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+  switch (uMsg)
+  {
+  case WM_REGISTER_FOLLOWER:
+    // Single-follower child registering; route it to its parent (or the pool)
+    BrokerRouteFollower((HWND)wParam);
+    return 0;
+
+  case WM_COPYDATA:
+  {
+    COPYDATASTRUCT* pCopyData = (COPYDATASTRUCT*)lParam;
+    if (pCopyData == NULL)
+    {
+      return DefWindowProc(hwnd, uMsg, wParam, lParam);
+    }
+
+    // Multi-follower child registering all of its followers
+    if (pCopyData->dwData == FOLLOWERS_COPYDATA_ID)
+    {
+      if (pCopyData->lpData == NULL || pCopyData->cbData % sizeof(UINT64) != 0)
+      {
+        OutputDebugString(L"Broker: Ignoring malformed follower registration\n");
+        return FALSE;
+      }
+
+      const UINT64* followerHandles = (const UINT64*)pCopyData->lpData;
+      int count = (int)(pCopyData->cbData / sizeof(UINT64));
+      for (int i = 0; i < count; i++)
+      {
+        BrokerRouteFollower((HWND)(ULONG_PTR)followerHandles[i]);
+      }
+      return TRUE;
+    }
+
+    // Startup trace spans of a child; forward them to the parent it was assigned to
+    if (pCopyData->dwData == TRACE_COPYDATA_ID)
+    {
+      BrokerForwardTraceSpans((HWND)wParam, pCopyData);
+      return TRUE;
+    }
+
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+  }
+
+  case WM_BROKER_ATTACH:
+  {
+    // Parent attaching through the client API
+    BrokerAttachRequest request = { 0 };
+    request.parentHwnd = (HWND)wParam;
+    request.followerCount = (INT32)(lParam & 0xFF);
+    request.followerThreadCount = (INT32)((lParam >> 8) & 0xFF);
+    request.useAppContainer = (INT32)((lParam >> 16) & 0x1);
+    return BrokerAttachParent(request) ? TRUE : FALSE;
+  }
+
+  case WM_BROKER_DETACH:
+    BrokerDetachParent((HWND)wParam);
+    return 0;
+
+  case WM_TIMER:
+    if (wParam == BROKER_HEALTH_TIMER_ID)
+    {
+      BrokerCheckHealth();
+      return 0;
+    }
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+
+  case WM_DESTROY:
+    KillTimer(hwnd, BROKER_HEALTH_TIMER_ID);
+    PostQuitMessage(0);
+    return 0;
+
+  default:
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+  }
+}
+
+BrokerChild* BrokerSpawnChild(bool useAppContainer, int followers, int followerThreads, HWND parentHwnd)
+{
+  if (g_brokerChildCount >= MAX_BROKER_CHILDREN)
+  {
+    OutputDebugString(L"Broker: Child process limit reached\n");
+    return NULL;
+  }
+
+  // Children register with the broker, which routes their followers on; they
+  // stay hidden until adopted by a parent
+  ChildLaunchOptions options = { 0 };
+  options.followers = followers;
+  options.followerThreads = followerThreads;
+  options.registrationHwnd = g_hwndBroker;
+  options.startHidden = true;
+
+  HANDLE hProcess = NULL;
+  if (!SpawnChildProcess(useAppContainer, options, &hProcess))
+    return NULL;
+
+  BrokerChild& child = g_brokerChildren[g_brokerChildCount++];
+  ZeroMemory(&child, sizeof(child));
+  child.hProcess = hProcess;
+  child.processId = GetProcessId(hProcess);
+  child.state = BrokerChildStarting;
+  child.parentHwnd = parentHwnd;
+  child.useAppContainer = useAppContainer;
+  child.followerCount = followers;
+  child.followerThreadCount = followerThreads;
+  child.startDeadline = GetTickCount64() + BROKER_CHILD_START_TIMEOUT_MS;
+  g_brokerSpawnCount++;
+
+  return &child;
+}
+
+void BrokerRouteFollower(HWND followerHwnd)
+{
+  // Only accept followers owned by a child this broker spawned
+  DWORD processId = 0;
+  GetWindowThreadProcessId(followerHwnd, &processId);
+
+  BrokerChild* child = NULL;
+  for (int i = 0; i < g_brokerChildCount; i++)
+  {
+    if (g_brokerChildren[i].processId == processId && g_brokerChildren[i].state == BrokerChildStarting)
+    {
+      child = &g_brokerChildren[i];
+      break;
+    }
+  }
+
+  if (child == NULL || child->registeredCount >= child->followerCount)
+  {
+    OutputDebugString(L"Broker: Ignoring follower from unknown child process\n");
+    return;
+  }
+
+  child->followers[child->registeredCount++] = followerHwnd;
+  if (child->registeredCount < child->followerCount)
+    return;
+
+  if (child->parentHwnd == NULL)
+  {
+    child->state = BrokerChildWarm;
+    OutputDebugString(L"Broker: Child process warm and pooled\n");
+    return;
+  }
+
+  // Deliver through the parent's regular registration path
+  child->state = BrokerChildAssigned;
+  for (int i = 0; i < child->followerCount; i++)
+  {
+    PostMessage(child->parentHwnd, WM_REGISTER_FOLLOWER, (WPARAM)child->followers[i], 0);
+  }
+}
+
+void BrokerForwardTraceSpans(HWND followerHwnd, const COPYDATASTRUCT* pCopyData)
+{
+  DWORD processId = 0;
+  GetWindowThreadProcessId(followerHwnd, &processId);
+
+  HWND parentHwnd = NULL;
+  for (int i = 0; i < g_brokerChildCount; i++)
+  {
+    if (g_brokerChildren[i].processId == processId && g_brokerChildren[i].state == BrokerChildAssigned)
+    {
+      parentHwnd = g_brokerChildren[i].parentHwnd;
+      break;
+    }
+  }
+
+  // Pooled children start ahead of any parent, so their spans have nowhere to go
+  if (parentHwnd == NULL)
+  {
+    OutputDebugString(L"Broker: Dropping trace spans of a pooled child process\n");
+    return;
+  }
+
+  if (pCopyData->lpData == NULL || pCopyData->cbData % sizeof(TraceSpan) != 0)
+  {
+    OutputDebugString(L"Broker: Ignoring malformed trace data\n");
+    return;
+  }
+
+  // Relayed as is; the spans carry the child's pid and absolute QPC timestamps
+  COPYDATASTRUCT copyData = *pCopyData;
+  DWORD_PTR result = 0;
+  if (!SendMessageTimeout(parentHwnd, WM_COPYDATA, (WPARAM)followerHwnd, (LPARAM)&copyData,
+    SMTO_ABORTIFHUNG, 500, &result))
+  {
+    OutputDebugString(L"Broker: Forwarding trace spans to parent failed\n");
+  }
+}
+
+bool IsTrustedBrokerClient(HWND parentHwnd)
+{
+  DWORD processId = 0;
+  GetWindowThreadProcessId(parentHwnd, &processId);
+  if (processId == 0)
+    return false;
+
+  // The broker's own children never get to adopt followers
+  for (int i = 0; i < g_brokerChildCount; i++)
+  {
+    if (g_brokerChildren[i].processId == processId)
+      return false;
+  }
+
+  HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+  if (hProcess == NULL)
+    return false;
+
+  // The window's owner must be neither in an app container nor below medium integrity,
+  // so a request can never obtain followers at a higher trust level than its own
+  bool trusted = false;
+  HANDLE hToken = NULL;
+  if (OpenProcessToken(hProcess, TOKEN_QUERY, &hToken))
+  {
+    DWORD isAppContainer = 0;
+    DWORD integrityBuffer[64]; // TOKEN_MANDATORY_LABEL followed by its SID
+    DWORD size = 0;
+
+    if (GetTokenInformation(hToken, TokenIsAppContainer, &isAppContainer, sizeof(isAppContainer), &size) &&
+      !isAppContainer &&
+      GetTokenInformation(hToken, TokenIntegrityLevel, integrityBuffer, sizeof(integrityBuffer), &size))
+    {
+      PSID integritySid = ((TOKEN_MANDATORY_LABEL*)integrityBuffer)->Label.Sid;
+      DWORD integrityLevel = *GetSidSubAuthority(integritySid, *GetSidSubAuthorityCount(integritySid) - 1);
+      trusted = (integrityLevel >= SECURITY_MANDATORY_MEDIUM_RID);
+    }
+
+    CloseHandle(hToken);
+  }
+
+  CloseHandle(hProcess);
+  return trusted;
+}
+
+bool BrokerAttachParent(const BrokerAttachRequest& request)
+{
+  HWND parentHwnd = request.parentHwnd;
+  if (!IsWindow(parentHwnd))
+  {
+    OutputDebugString(L"Broker: Ignoring attach from invalid parent window\n");
+    return false;
+  }
+
+  if (!IsTrustedBrokerClient(parentHwnd))
+  {
+    OutputDebugString(L"Broker: Rejecting attach for a window owned by a low trust process\n");
+    return false;
+  }
+
+  if (g_brokerParentCount >= MAX_BROKER_PARENTS)
+  {
+    OutputDebugString(L"Broker: Parent limit reached\n");
+    return false;
+  }
+
+  g_brokerParents[g_brokerParentCount++] = parentHwnd;
+
+  int followers = request.followerCount;
+  if (followers < 1)
+    followers = 1;
+  if (followers > MAX_FOLLOWERS)
+    followers = MAX_FOLLOWERS;
+  int followerThreads = request.followerThreadCount;
+  if (followerThreads < 0)
+    followerThreads = 0;
+  if (followerThreads > MAX_FOLLOWER_THREADS)
+    followerThreads = MAX_FOLLOWER_THREADS;
+  if (followerThreads > followers)
+    followerThreads = followers;
+  bool useAppContainer = (request.useAppContainer != 0);
+
+  // The warm pool holds single-follower children at the broker's trust level
+  if (followers == 1 && useAppContainer == g_brokerUseAppContainer)
+  {
+    for (int i = 0; i < g_brokerChildCount; i++)
+    {
+      BrokerChild& child = g_brokerChildren[i];
+      if (child.state == BrokerChildWarm)
+      {
+        child.state = BrokerChildAssigned;
+        child.parentHwnd = parentHwnd;
+        PostMessage(parentHwnd, WM_REGISTER_FOLLOWER, (WPARAM)child.followers[0], 0);
+        g_brokerPoolHits++;
+        OutputDebugString(L"Broker: Parent attached, served from warm pool\n");
+        BrokerReplenishPool();
+        return true;
+      }
+    }
+  }
+
+  // Pool miss (empty pool, multiple followers or different trust level): spawn on demand
+  g_brokerPoolMisses++;
+  if (BrokerSpawnChild(useAppContainer, followers, followerThreads, parentHwnd) == NULL)
+  {
+    // The parent was added last; drop it so it fails the attach instead of waiting
+    g_brokerParentCount--;
+    OutputDebugString(L"Broker: Failed to spawn child process for parent\n");
+    BrokerReplenishPool();
+    return false;
+  }
+
+  OutputDebugString(L"Broker: Parent attached, child process spawned on demand\n");
+  BrokerReplenishPool();
+  return true;
+}
+
+void BrokerReleaseChild(BrokerChild& child)
+{
+  // Close the followers so the child exits on its own; the health check
+  // terminates it if it is still running after the grace period
+  if (child.registeredCount > 0)
+  {
+    for (int i = 0; i < child.registeredCount; i++)
+    {
+      PostMessage(child.followers[i], WM_CLOSE, 0, 0);
+    }
+    child.closeDeadline = GetTickCount64() + BROKER_CLOSE_GRACE_MS;
+  }
+  else
+  {
+    child.closeDeadline = GetTickCount64();
+  }
+
+  child.state = BrokerChildClosing;
+  child.parentHwnd = NULL;
+}
+
+void BrokerDetachParent(HWND parentHwnd)
+{
+  bool found = false;
+  for (int i = 0; i < g_brokerParentCount; i++)
+  {
+    if (g_brokerParents[i] == parentHwnd)
+    {
+      g_brokerParents[i] = g_brokerParents[--g_brokerParentCount];
+      found = true;
+      break;
+    }
+  }
+
+  if (!found)
+    return;
+
+  for (int i = 0; i < g_brokerChildCount; i++)
+  {
+    BrokerChild& child = g_brokerChildren[i];
+    if (child.parentHwnd == parentHwnd && child.state != BrokerChildClosing)
+    {
+      BrokerReleaseChild(child);
+    }
+  }
+
+  wchar_t buffer[256];
+  swprintf_s(buffer, L"Broker: Parent %p detached, %d parent(s) remain\n", parentHwnd, g_brokerParentCount);
+  OutputDebugString(buffer);
+}
+
+void BrokerReplenishPool()
+{
+  int pooled = 0;
+  for (int i = 0; i < g_brokerChildCount; i++)
+  {
+    const BrokerChild& child = g_brokerChildren[i];
+    if (child.parentHwnd == NULL &&
+      (child.state == BrokerChildWarm || child.state == BrokerChildStarting))
+    {
+      pooled++;
+    }
+  }
+
+  for (; pooled < g_brokerPoolSize; pooled++)
+  {
+    if (BrokerSpawnChild(g_brokerUseAppContainer, 1, 0, NULL) == NULL)
+      break;
+  }
+}
+
+void BrokerCheckHealth()
+{
+  ULONGLONG now = GetTickCount64();
+
+  // Parents that went away without detaching (e.g. crashed)
+  for (int i = g_brokerParentCount - 1; i >= 0; i--)
+  {
+    if (!IsWindow(g_brokerParents[i]))
+    {
+      OutputDebugString(L"Broker: Parent window gone, releasing its followers\n");
+      BrokerDetachParent(g_brokerParents[i]);
+    }
+  }
+
+  for (int i = g_brokerChildCount - 1; i >= 0; i--)
+  {
+    BrokerChild& child = g_brokerChildren[i];
+
+    // A child hung before registering would hold its parent (or pool slot) forever;
+    // terminate it so it is replaced below like any other child that died
+    if (child.state == BrokerChildStarting && now >= child.startDeadline)
+    {
+      OutputDebugString(L"Broker: Child process didn't register in time, terminating...\n");
+      TerminateProcess(child.hProcess, 1);
+      WaitForSingleObject(child.hProcess, 1000);
+    }
+
+    if (WaitForSingleObject(child.hProcess, 0) == WAIT_OBJECT_0)
+    {
+      // A child that dies before reaching or while serving its parent leaves the parent
+      // short of followers (or holding dead ones), so tell it and spawn a replacement
+      BrokerChild lost = child;
+      CloseHandle(child.hProcess);
+      g_brokerChildren[i] = g_brokerChildren[--g_brokerChildCount];
+
+      if (lost.state != BrokerChildClosing)
+      {
+        wchar_t buffer[256];
+        swprintf_s(buffer, L"Broker: Child process %lu exited unexpectedly (parent %p)\n",
+          lost.processId, lost.parentHwnd);
+        OutputDebugString(buffer);
+      }
+
+      if (lost.state != BrokerChildClosing && lost.parentHwnd != NULL && IsWindow(lost.parentHwnd))
+      {
+        if (lost.state == BrokerChildAssigned)
+        {
+          PostMessage(lost.parentHwnd, WM_FOLLOWERS_LOST, (WPARAM)lost.processId, 0);
+        }
+
+        BrokerChild* replacement = NULL;
+        if (lost.respawnCount < BROKER_MAX_RESPAWNS)
+        {
+          replacement = BrokerSpawnChild(lost.useAppContainer, lost.followerCount,
+            lost.followerThreadCount, lost.parentHwnd);
+        }
+
+        if (replacement != NULL)
+        {
+          replacement->respawnCount = lost.respawnCount + 1;
+          OutputDebugString(L"Broker: Respawned child process for its parent\n");
+        }
+        else
+        {
+          OutputDebugString(L"Broker: Giving up on replacing child process\n");
+        }
+      }
+      continue;
+    }
+
+    if (child.state == BrokerChildClosing && now >= child.closeDeadline)
+    {
+      OutputDebugString(L"Broker: Child process didn't exit gracefully, force terminating...\n");
+      TerminateProcess(child.hProcess, 0);
+    }
+  }
+
+  BrokerReplenishPool();
+
+  // Exit once no parent has been attached for a while
+  if (g_brokerParentCount > 0)
+  {
+    g_brokerIdleSinceTick = 0;
+  }
+  else if (g_brokerIdleSinceTick == 0)
+  {
+    g_brokerIdleSinceTick = now;
+  }
+  else if (now - g_brokerIdleSinceTick >= BROKER_IDLE_EXIT_MS)
+  {
+    OutputDebugString(L"Broker: Idle, shutting down\n");
+    DestroyWindow(g_hwndBroker);
+  }
+}
+
+HWND FindOrStartBroker(bool useAppContainer)
+{
+  HWND broker = FindWindowEx(HWND_MESSAGE, NULL, L"TrackerBrokerClass", NULL);
+  if (broker != NULL)
+    return broker;
+
+  wchar_t exePath[MAX_PATH];
+  if (GetModuleFileName(NULL, exePath, MAX_PATH) == 0)
+  {
+    OutputDebugString(L"Failed to get executable path\n");
+    return NULL;
+  }
+
+  // A tracing broker passes --trace on to its children, which send their spans to it
+  // for forwarding; tracing is fixed by the parent that starts the broker
+  wchar_t cmdLine[512];
+  swprintf_s(cmdLine, L"\"%s\" --broker --pool_size %d%s%s",
+    exePath, g_brokerPoolSize, useAppContainer ? L" --launch_child_ac" : L"",
+    g_TraceEnabled ? L" --trace" : L"");
+
+  STARTUPINFO si = { 0 };
+  si.cb = sizeof(si);
+  PROCESS_INFORMATION pi = { 0 };
+
+  // The broker outlives this parent, so its handles are not kept
+  if (!CreateProcess(NULL, cmdLine, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+  {
+    DWORD error = GetLastError();
+    wchar_t errorMsg[256];
+    swprintf_s(errorMsg, L"Failed to spawn broker process. Error code: %d\n", error);
+    OutputDebugString(errorMsg);
+    return NULL;
+  }
+
+  CloseHandle(pi.hThread);
+  CloseHandle(pi.hProcess);
+
+  // Wait for the broker window to appear
+  ULONGLONG deadline = GetTickCount64() + BROKER_START_TIMEOUT_MS;
+  while (broker == NULL && GetTickCount64() < deadline)
+  {
+    Sleep(20);
+    broker = FindWindowEx(HWND_MESSAGE, NULL, L"TrackerBrokerClass", NULL);
+  }
+
+  return broker;
+}
+
+bool BrokerAttach(HWND hwndMain, bool useAppContainer)
+{
+  g_hwndBroker = FindOrStartBroker(useAppContainer);
+  if (g_hwndBroker == NULL)
+  {
+    OutputDebugString(L"Parent: Broker not available\n");
+    return false;
+  }
+
+  // Both counts are clamped to MAX_FOLLOWERS (64), so they fit in their 8-bit fields
+  LPARAM request = (LPARAM)g_followerCount |
+    ((LPARAM)g_followerThreadCount << 8) |
+    ((LPARAM)(useAppContainer ? 1 : 0) << 16);
+
+  // The broker may have been shutting down when it was found; start or find its
+  // successor and try once more
+  DWORD_PTR result = 0;
+  if (!SendMessageTimeout(g_hwndBroker, WM_BROKER_ATTACH, (WPARAM)hwndMain, request,
+    SMTO_ABORTIFHUNG, 5000, &result))
+  {
+    OutputDebugString(L"Parent: Broker did not answer, retrying\n");
+    g_hwndBroker = FindOrStartBroker(useAppContainer);
+    if (g_hwndBroker == NULL || !SendMessageTimeout(g_hwndBroker, WM_BROKER_ATTACH, (WPARAM)hwndMain, request,
+      SMTO_ABORTIFHUNG, 5000, &result))
+    {
+      result = FALSE;
+    }
+  }
+
+  if (result != TRUE)
+  {
+    OutputDebugString(L"Parent: Broker attach request failed\n");
+    g_hwndBroker = NULL;
+    return false;
+  }
+
+  OutputDebugString(L"Parent: Attached to broker\n");
+  return true;
+}
+
+void BrokerDetach(HWND hwndMain)
+{
+  if (g_hwndBroker == NULL)
+    return;
+
+  PostMessage(g_hwndBroker, WM_BROKER_DETACH, (WPARAM)hwndMain, 0);
+  g_hwndBroker = NULL;
+}
+
+int RunZOrderBenchmark()
+{
+  // Compares ApplyFollowerZOrder's minimal reorders against re-topping every
+  // follower, replaying the same move sequence on a simulated stack to verify it
+  const int followerCounts[] = { 4, 16, 64 };
+  const wchar_t* scenarios[] = { L"in_order", L"raise_one", L"swap_pair", L"reverse", L"shuffle" };
+  const int iterations = 1000;
+  unsigned int seed = 12345;
+  int failures = 0;
+
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+
+  for (int followerCount : followerCounts)
+  {
+    for (int scenario = 0; scenario < (int)_countof(scenarios); scenario++)
+    {
+      LONGLONG naiveOps = 0;
+      LONGLONG minimalOps = 0;
+      LONGLONG startQpc = QueryTraceClock();
+
+      for (int iteration = 0; iteration < iterations; iteration++)
+      {
+        // stack[i] is the desired rank of the window currently at position i
+        int stack[MAX_FOLLOWERS];
+        for (int i = 0; i < followerCount; i++)
+        {
+          stack[i] = i;
+        }
+
+        seed = seed * 1103515245 + 12345;
+        int a = (int)((seed >> 16) % followerCount);
+        seed = seed * 1103515245 + 12345;
+        int b = (int)((seed >> 16) % followerCount);
+
+        if (scenario == 1)
+        {
+          // Window a sits on top while it should be further down
+          int raised = stack[a];
+          for (int i = a; i > 0; i--)
+            stack[i] = stack[i - 1];
+          stack[0] = raised;
+        }
+        else if (scenario == 2)
+        {
+          int swapped = stack[a];
+          stack[a] = stack[b];
+          stack[b] = swapped;
+        }
+        else if (scenario == 3)
+        {
+          for (int i = 0; i < followerCount / 2; i++)
+          {
+            int swapped = stack[i];
+            stack[i] = stack[followerCount - 1 - i];
+            stack[followerCount - 1 - i] = swapped;
+          }
+        }
+        else if (scenario == 4)
+        {
+          for (int i = followerCount - 1; i > 0; i--)
+          {
+            seed = seed * 1103515245 + 12345;
+            int j = (int)((seed >> 16) % (i + 1));
+            int swapped = stack[i];
+            stack[i] = stack[j];
+            stack[j] = swapped;
+          }
+        }
+
+        bool keepRank[MAX_FOLLOWERS];
+        minimalOps += ComputeZOrderMoves(stack, followerCount, keepRank);
+        naiveOps += followerCount;
+
+        // Replay the moves the way ApplyFollowerZOrder issues them
+        int previousRank = -1;
+        for (int rank = 0; rank < followerCount; rank++)
+        {
+          if (!keepRank[rank])
+          {
+            int from = 0;
+            while (stack[from] != rank)
+              from++;
+            for (int i = from; i < followerCount - 1; i++)
+              stack[i] = stack[i + 1];
+
+            int to = 0;
+            if (previousRank >= 0)
+            {
+              while (stack[to] != previousRank)
+                to++;
+              to++;
+            }
+            for (int i = followerCount - 1; i > to; i--)
+              stack[i] = stack[i - 1];
+            stack[to] = rank;
+          }
+          previousRank = rank;
+        }
+
+        for (int i = 0; i < followerCount; i++)
+        {
+          if (stack[i] != i)
+          {
+            failures++;
+            break;
+          }
+        }
+      }
+
+      double elapsedUs = (double)(QueryTraceClock() - startQpc) * 1000000.0 / (double)frequency.QuadPart;
+
+      wchar_t buffer[256];
+      swprintf_s(buffer,
+        L"ZOrderBenchmark: followers=%d scenario=%s naive_ops=%lld minimal_ops=%lld saved=%.1f%% (%.2f us/iteration)\n",
+        followerCount, scenarios[scenario], naiveOps, minimalOps,
+        100.0 * (double)(naiveOps - minimalOps) / (double)naiveOps, elapsedUs / iterations);
+      OutputDebugString(buffer);
+    }
+  }
+
+  wchar_t buffer[256];
+  swprintf_s(buffer, L"ZOrderBenchmark: %d incorrect orderings\n", failures);
+  OutputDebugString(buffer);
+
+  return failures == 0 ? 0 : 1;
+}
+
+int RunParentProcess(HINSTANCE hInstance, int nCmdShow, bool useAppContainer)
+{
+  // Register main window class
+  WNDCLASSEX wcMain = { 0 };
+  wcMain.cbSize = sizeof(WNDCLASSEX);
+  wcMain.style = CS_HREDRAW | CS_VREDRAW;
+  wcMain.lpfnWndProc = MainWindowProc;
+  wcMain.hInstance = hInstance;
+  wcMain.hCursor = LoadCursor(NULL, IDC_ARROW);
+  wcMain.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+  wcMain.lpszClassName = L"MainWindowClass";
+
+  ATOM mainClass;
+  {
+    ScopedTraceSpan traceSpan("RegisterClassEx");
+    mainClass = RegisterClassEx(&wcMain);
+  }
+
+  if (!mainClass)
+  {
+    MessageBox(NULL, L"Failed to register main window class", L"Error", MB_OK);
+    return 1;
+  }
+
+  // Create main window
+  {
+    ScopedTraceSpan traceSpan("CreateMainWindow");
+    g_hwndMain = CreateMainWindow(hInstance);
+  }
+  if (!g_hwndMain)
+  {
+    MessageBox(NULL, L"Failed to create main window", L"Error", MB_OK);
+    return 1;
+  }
+
+  // A brokered parent only takes registrations from the broker, which runs at its own
+  // integrity level, so low IL senders stay filtered
+  if (!g_useBroker)
+  {
+    // Allow custom message from low IL process
+    ChangeWindowMessageFilterEx(g_hwndMain, WM_REGISTER_FOLLOWER, MSGFLT_ALLOW, nullptr);
+
+    OutputDebugString(L"Parent: ChangeWindowMessageFilterEx called for WM_REGISTER_FOLLOWER\n");
+
+    // Allow follower handshakes and trace spans sent by children (WM_COPYDATA is filtered for low IL senders too)
+    ChangeWindowMessageFilterEx(g_hwndMain, WM_COPYDATA, MSGFLT_ALLOW, nullptr);
+  }
+
+  // Show main window
+  {
+    ScopedTraceSpan traceSpan("ShowMainWindow");
+    ShowWindow(g_hwndMain, nCmdShow);
+    UpdateWindow(g_hwndMain);
+  }
+
+  // Occlusion has no notification of its own, so poll for it
+  SetTimer(g_hwndMain, HOST_VISIBILITY_TIMER_ID, HOST_VISIBILITY_POLL_MS, NULL);
+
+  // A brokered parent gets its followers routed from the session broker instead
+  if (g_useBroker)
+  {
+    ScopedTraceSpan traceSpan("BrokerAttach");
+    if (!BrokerAttach(g_hwndMain, useAppContainer))
+    {
+      MessageBox(NULL, L"Failed to attach to broker", L"Error", MB_OK);
+      return 1;
+    }
+  }
+
+  // Spawn child processes (using app container if requested): one host child for
+  // all followers, or one child per follower with --process_per_follower.
+  // In process-per-follower mode every child hosts exactly one follower
+  ChildLaunchOptions options = { 0 };
+  options.followers = g_processPerFollower ? 1 : g_followerCount;
+  options.followerThreads = g_processPerFollower ? 0 : g_followerThreadCount;
+  options.registrationHwnd = g_hwndMain;
+  options.startHidden = false;
+
+  int childProcessCount = g_useBroker ? 0 : (g_processPerFollower ? g_followerCount : 1);
+  for (int i = 0; i < childProcessCount; i++)
+  {
+    HANDLE hProcess = NULL;
+    bool spawned;
+    {
+      ScopedTraceSpan traceSpan("SpawnChildProcess");
+      spawned = SpawnChildProcess(useAppContainer, options, &hProcess);
+    }
+    if (!spawned)
+    {
+      TerminateChildProcesses();
+      MessageBox(NULL, L"Failed to spawn child process", L"Error", MB_OK);
+      return 1;
+    }
+
+    // Store the child process handle for later cleanup
+    g_hChildProcesses[g_childProcessCount++] = hProcess;
+  }
+
+  // Baseline for the per-visibility-interval resource reports
+  SIZE_T workingSet;
+  SIZE_T privateBytes;
+  QueryChildResourceUsage(&workingSet, &privateBytes, &g_usageSampleCpuTime);
+  g_usageSampleQpc = QueryTraceClock();
+
+  // Message loop for parent process (only handles main window)
+  MSG msg;
+  while (GetMessage(&msg, NULL, 0, 0))
+  {
+    TranslateMessage(&msg);
+    DispatchMessage(&msg);
+  }
+
+  // Cleanup app container when parent process exits (only if we created it;
+  // a brokered parent leaves the profile to the broker)
+  if (g_appContainerSid != NULL)
+  {
+    CleanupAppContainer();
+  }
+
+  wchar_t buffer[256];
+  swprintf_s(buffer, L"Parent: Z-order reorders issued: %lld, saved: %lld\n",
+    g_zOrderOpsIssued, g_zOrderOpsSaved);
+  OutputDebugString(buffer);
+
+  WriteTraceFile();
+
+  return (int)msg.wParam;
+}
+
+int RunChildProcess(HINSTANCE hInstance)
+{
+  OutputDebugString(L"Child process starting\n");
+
+  // Register follower window class
+  WNDCLASSEX wcFollower = { 0 };
+  wcFollower.cbSize = sizeof(WNDCLASSEX);
+  wcFollower.style = CS_HREDRAW | CS_VREDRAW;
+  wcFollower.lpfnWndProc = FollowerWindowProc;
+  wcFollower.hInstance = hInstance;
+  wcFollower.hCursor = LoadCursor(NULL, IDC_ARROW);
+  wcFollower.hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
+  wcFollower.lpszClassName = L"FollowerWindowClass";
+
+  ATOM followerClass;
+  {
+    ScopedTraceSpan traceSpan("ChildRegisterClassEx");
+    followerClass = RegisterClassEx(&wcFollower);
+  }
+
+  if (!followerClass)
+  {
+    MessageBox(NULL, L"Failed to register follower window class", L"Error", MB_OK);
+    return 1;
+  }
+
+  // Render resources shared by every follower hosted in this process
+  g_followerBrush = CreateSolidBrush(RGB(200, 220, 255)); // Light blue
+  g_followerPen = CreatePen(PS_SOLID, 2, RGB(0, 0, 255)); // Blue border
+
+  // Create and show follower windows, either on this thread or on a pool of UI threads
+  bool created;
+  {
+    ScopedTraceSpan traceSpan("CreateFollowerWindows");
+    if (g_followerThreadCount == 0)
+    {
+      created = CreateFollowerWindows(hInstance, 0, 1);
+    }
+    else
+    {
+      created = StartFollowerThreads(hInstance);
+    }
+  }
+  if (!created)
+  {
+    MessageBox(NULL, L"Failed to create follower window", L"Error", MB_OK);
+    return 1;
+  }
+
+  // Register with the window named on the command line (parent or broker);
+  // fall back to finding the main window by class name
+  HWND mainHwnd = (g_hwndRegistration != NULL && IsWindow(g_hwndRegistration)) ? g_hwndRegistration : NULL;
+  if (mainHwnd == NULL)
+  {
+    ScopedTraceSpan traceSpan("FindWindow");
+    mainHwnd = FindWindow(L"MainWindowClass", NULL);
+  }
 
   if (mainHwnd == NULL)
   {
@@ -737,32 +2802,157 @@ int RunChildProcess(HINSTANCE hInstance)
   swprintf_s(buffer, L"Child: Found main window HWND: %p\n", mainHwnd);
   OutputDebugString(buffer);
 
-  OutputDebugString(L"Child: Sending WM_REGISTER_FOLLOWER to parent\n");
+  LONGLONG sendStartQpc = QueryTraceClock();
+  BOOL sendResult;
+  if (g_followerCount == 1)
+  {
+    OutputDebugString(L"Child: Sending WM_REGISTER_FOLLOWER to parent\n");
+
+    // Send the follower window handle to the parent process
+    // Using SendMessageCallback to avoid blocking and allow message pumping during SetParent
+    sendResult = SendMessageCallback(
+      mainHwnd,
+      WM_REGISTER_FOLLOWER,
+      (WPARAM)g_hwndFollowers[0],
+      0,
+      nullptr,  // No callback function needed
+      0);       // No user data
+
+    if (sendResult)
+    {
+      OutputDebugString(L"Child: SendMessageCallback succeeded\n");
+    }
+    else
+    {
+      DWORD error = GetLastError();
+      swprintf_s(buffer, L"Child: SendMessageCallback failed with error: %d\n", error);
+      OutputDebugString(buffer);
+    }
+  }
+  else
+  {
+    swprintf_s(buffer, L"Child: Registering %d followers with parent\n", g_followerCount);
+    OutputDebugString(buffer);
+
+    // Register all hosted followers in a single handshake
+    sendResult = RegisterFollowersWithParent(mainHwnd);
 
-  // Send the follower window handle to the parent process
-  // Using SendMessageCallback to avoid blocking and allow message pumping during SetParent
-  BOOL sendResult = SendMessageCallback(
-    mainHwnd,
-    WM_REGISTER_FOLLOWER,
-    (WPARAM)g_hwndFollower,
-    0,
-    nullptr,  // No callback function needed
-    0);       // No user data
+    if (sendResult)
+    {
+      OutputDebugString(L"Child: Follower registration succeeded\n");
+    }
+    else
+    {
+      DWORD error = GetLastError();
+      swprintf_s(buffer, L"Child: Follower registration failed with error: %d\n", error);
+      OutputDebugString(buffer);
+    }
+  }
 
+  RecordTraceSpan("SendRegistration", sendStartQpc, QueryTraceClock());
+  RecordTraceSpan("ChildStartup", g_traceOriginQpc, QueryTraceClock());
   if (sendResult)
   {
-    OutputDebugString(L"Child: SendMessageCallback succeeded\n");
+    SendTraceSpansToParent(mainHwnd);
   }
   else
   {
-    DWORD error = GetLastError();
-    swprintf_s(buffer, L"Child: SendMessageCallback failed with error: %d\n", error);
-    OutputDebugString(buffer);
+    // Nobody will adopt the followers; close them (on their own threads) instead of
+    // leaving ownerless popups behind, and exit once they are gone
+    OutputDebugString(L"Child: Registration failed, closing follower windows\n");
+    for (int i = 0; i < g_followerCount; i++)
+    {
+      PostMessage(g_hwndFollowers[i], WM_CLOSE, 0, 0);
+    }
+  }
+
+  int exitCode = 0;
+  if (g_followerThreadCount == 0)
+  {
+    // Message loop for child process - CRITICAL for avoiding deadlock
+    // This ensures the child process continues pumping messages while
+    // the parent process performs SetParent operation
+    MSG msg;
+    while (GetMessage(&msg, NULL, 0, 0))
+    {
+      TranslateMessage(&msg);
+      DispatchMessage(&msg);
+    }
+    exitCode = (int)msg.wParam;
+  }
+  else
+  {
+    // Follower threads pump their own messages; exit once all have finished
+    WaitForMultipleObjects(g_followerThreadCount, g_hFollowerThreads, TRUE, INFINITE);
+    for (int i = 0; i < g_followerThreadCount; i++)
+    {
+      CloseHandle(g_hFollowerThreads[i]);
+      g_hFollowerThreads[i] = NULL;
+    }
+  }
+
+  DeleteObject(g_followerPen);
+  DeleteObject(g_followerBrush);
+
+  return sendResult ? exitCode : 1;
+}
+
+int RunBrokerProcess(HINSTANCE hInstance)
+{
+  // One broker per session. A broker that is shutting down releases the mutex as soon
+  // as its window is gone, so give it a moment before deciding another one is running
+  HANDLE hBrokerMutex = CreateMutex(NULL, TRUE, L"Local\\XprocHwndTracker.Broker");
+  if (hBrokerMutex == NULL)
+    return 1;
+  if (GetLastError() == ERROR_ALREADY_EXISTS)
+  {
+    DWORD waitResult = WaitForSingleObject(hBrokerMutex, BROKER_START_TIMEOUT_MS);
+    if (waitResult != WAIT_OBJECT_0 && waitResult != WAIT_ABANDONED)
+    {
+      OutputDebugString(L"Broker: Another broker is already running\n");
+      CloseHandle(hBrokerMutex);
+      return 0;
+    }
+  }
+
+  WNDCLASSEX wcBroker = { 0 };
+  wcBroker.cbSize = sizeof(WNDCLASSEX);
+  wcBroker.lpfnWndProc = BrokerWindowProc;
+  wcBroker.hInstance = hInstance;
+  wcBroker.lpszClassName = L"TrackerBrokerClass";
+
+  if (!RegisterClassEx(&wcBroker))
+  {
+    OutputDebugString(L"Broker: Failed to register broker window class\n");
+    CloseHandle(hBrokerMutex);
+    return 1;
+  }
+
+  // Message-only window: never shown, found by parents with FindWindowEx(HWND_MESSAGE, ...)
+  g_hwndBroker = CreateWindowEx(0, L"TrackerBrokerClass", L"Tracker Broker", 0,
+    0, 0, 0, 0, HWND_MESSAGE, NULL, hInstance, NULL);
+  if (!g_hwndBroker)
+  {
+    OutputDebugString(L"Broker: Failed to create broker window\n");
+    CloseHandle(hBrokerMutex);
+    return 1;
+  }
+
+  // Allow registrations from low IL children
+  ChangeWindowMessageFilterEx(g_hwndBroker, WM_REGISTER_FOLLOWER, MSGFLT_ALLOW, nullptr);
+  ChangeWindowMessageFilterEx(g_hwndBroker, WM_COPYDATA, MSGFLT_ALLOW, nullptr);
+
+  // The app container profile is created once for every child of the session
+  if (g_brokerUseAppContainer && !EnsureAppContainerProfile())
+  {
+    OutputDebugString(L"Broker: Failed to set up app container profile\n");
   }
 
-  // Message loop for child process - CRITICAL for avoiding deadlock
-  // This ensures the child process continues pumping messages while
-  // the parent process performs SetParent operation
+  BrokerReplenishPool();
+  SetTimer(g_hwndBroker, BROKER_HEALTH_TIMER_ID, BROKER_HEALTH_POLL_MS, NULL);
+
+  OutputDebugString(L"Broker: Running\n");
+
   MSG msg;
   while (GetMessage(&msg, NULL, 0, 0))
   {
@@ -770,5 +2960,185 @@ int RunChildProcess(HINSTANCE hInstance)
     DispatchMessage(&msg);
   }
 
+  // The window is gone, so let a new broker start while the children drain
+  ReleaseMutex(hBrokerMutex);
+  CloseHandle(hBrokerMutex);
+
+  // Release every remaining child, then give them all one shared grace period
+  for (int i = 0; i < g_brokerChildCount; i++)
+  {
+    if (g_brokerChildren[i].state != BrokerChildClosing)
+    {
+      BrokerReleaseChild(g_brokerChildren[i]);
+    }
+  }
+  ULONGLONG drainDeadline = GetTickCount64() + BROKER_CLOSE_GRACE_MS;
+  for (int i = 0; i < g_brokerChildCount; i++)
+  {
+    BrokerChild& child = g_brokerChildren[i];
+    ULONGLONG now = GetTickCount64();
+    DWORD remainingMs = (now < drainDeadline) ? (DWORD)(drainDeadline - now) : 0;
+    if (WaitForSingleObject(child.hProcess, remainingMs) == WAIT_TIMEOUT)
+    {
+      TerminateProcess(child.hProcess, 0);
+    }
+    CloseHandle(child.hProcess);
+  }
+  g_brokerChildCount = 0;
+
+  // On-demand app container children may have set up the profile even without --launch_child_ac.
+  // A broker started meanwhile owns the profile from now on and keeps it
+  HANDLE hNextBroker = OpenMutex(SYNCHRONIZE, FALSE, L"Local\\XprocHwndTracker.Broker");
+  if (hNextBroker != NULL)
+  {
+    CloseHandle(hNextBroker);
+  }
+  else if (g_appContainerSid != NULL)
+  {
+    CleanupAppContainer();
+  }
+
+  wchar_t buffer[256];
+  swprintf_s(buffer, L"Broker: Exiting. Children spawned: %d, pool hits: %d, pool misses: %d\n",
+    g_brokerSpawnCount, g_brokerPoolHits, g_brokerPoolMisses);
+  OutputDebugString(buffer);
+
   return (int)msg.wParam;
+}
+
+int RunBrokerLoadTest(bool useAppContainer)
+{
+  // Starts N parents at once (brokered with --use_broker, otherwise each spawning
+  // its own children), each closing once its followers are registered. Every parent
+  // reports its own time to all followers, so teardown (which differs between the
+  // modes) stays out of the numbers
+  wchar_t exePath[MAX_PATH];
+  if (GetModuleFileName(NULL, exePath, MAX_PATH) == 0)
+  {
+    OutputDebugString(L"Failed to get executable path\n");
+    return 1;
+  }
+
+  // Start the broker ahead of timing, as a long-running session would already have it
+  if (g_useBroker && FindOrStartBroker(useAppContainer) == NULL)
+  {
+    OutputDebugString(L"BrokerLoadTest: Broker not available\n");
+    return 1;
+  }
+
+  // Direct-mode parents each own an app container profile, named per test run and parent
+  // so they can't delete one another's; the broker owns the profile otherwise
+  bool ownProfiles = useAppContainer && !g_useBroker;
+  wchar_t profileNames[MAX_BROKER_PARENTS][64];
+
+  wchar_t mappingName[64];
+  swprintf_s(mappingName, L"Local\\XprocHwndTracker.LoadTest.%lu", GetCurrentProcessId());
+  HANDLE hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+    sizeof(LoadTestResult) * MAX_BROKER_PARENTS, mappingName);
+  LoadTestResult* results = (hMapping != NULL) ?
+    (LoadTestResult*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : NULL;
+  if (results == NULL)
+  {
+    OutputDebugString(L"BrokerLoadTest: Failed to create the results mapping\n");
+    if (hMapping != NULL)
+      CloseHandle(hMapping);
+    return 1;
+  }
+
+  HANDLE parents[MAX_BROKER_PARENTS];
+  int parentCount = 0;
+  LONGLONG startQpc = QueryTraceClock();
+
+  for (int i = 0; i < g_brokerLoadTestParents; i++)
+  {
+    swprintf_s(profileNames[i], L"WindowFollower.AppContainer.LoadTest.%lu.%d", GetCurrentProcessId(), i);
+
+    wchar_t cmdLine[512];
+    swprintf_s(cmdLine, L"\"%s\" --followers %d --follower_threads %d --exit_after_followers"
+      L" --load_test_report %lu %d%s%s%s%s",
+      exePath, g_followerCount, g_followerThreadCount, GetCurrentProcessId(), i,
+      g_useBroker ? L" --use_broker" : L"",
+      useAppContainer ? L" --launch_child_ac" : L"",
+      ownProfiles ? L" --app_container_name " : L"",
+      ownProfiles ? profileNames[i] : L"");
+
+    STARTUPINFO si = { 0 };
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION pi = { 0 };
+
+    if (!CreateProcess(NULL, cmdLine, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+    {
+      DWORD error = GetLastError();
+      wchar_t errorMsg[256];
+      swprintf_s(errorMsg, L"BrokerLoadTest: Failed to spawn parent. Error code: %d\n", error);
+      OutputDebugString(errorMsg);
+      break;
+    }
+
+    CloseHandle(pi.hThread);
+    parents[parentCount++] = pi.hProcess;
+  }
+
+  DWORD waitResult = WaitForMultipleObjects(parentCount, parents, TRUE, 60000);
+
+  int failures = 0;
+  for (int i = 0; i < parentCount; i++)
+  {
+    DWORD exitCode = 0;
+    if (!GetExitCodeProcess(parents[i], &exitCode) || exitCode != 0)
+    {
+      failures++;
+      if (exitCode == STILL_ACTIVE)
+      {
+        TerminateProcess(parents[i], 1);
+        WaitForSingleObject(parents[i], 1000);
+      }
+
+      // A killed or crashed parent never got to delete its profile
+      if (ownProfiles)
+      {
+        DeleteAppContainerProfile(profileNames[i]);
+      }
+    }
+    CloseHandle(parents[i]);
+  }
+
+  // Aggregate what the parents reported: each one's own time to all followers, and
+  // the time from the first launch until the last parent had all of its followers
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  double msPerQpc = 1000.0 / (double)frequency.QuadPart;
+
+  int reported = 0;
+  double sumMs = 0.0;
+  double maxMs = 0.0;
+  LONGLONG lastAllFollowersQpc = startQpc;
+  for (int i = 0; i < parentCount; i++)
+  {
+    if (results[i].timeToAllFollowersQpc == 0)
+      continue;
+
+    double parentMs = (double)results[i].timeToAllFollowersQpc * msPerQpc;
+    sumMs += parentMs;
+    if (parentMs > maxMs)
+      maxMs = parentMs;
+    if (results[i].allFollowersQpc > lastAllFollowersQpc)
+      lastAllFollowersQpc = results[i].allFollowersQpc;
+    reported++;
+  }
+
+  wchar_t buffer[512];
+  swprintf_s(buffer,
+    L"BrokerLoadTest: mode=%s parents=%d followers_per_parent=%d reported=%d "
+    L"batch_to_all_followers=%.2f ms parent_time_to_all_followers avg=%.2f ms max=%.2f ms failures=%d%s\n",
+    g_useBroker ? L"broker" : L"direct", parentCount, g_followerCount, reported,
+    (double)(lastAllFollowersQpc - startQpc) * msPerQpc,
+    reported > 0 ? sumMs / reported : 0.0, maxMs, failures,
+    waitResult == WAIT_TIMEOUT ? L" (timed out)" : L"");
+  OutputDebugString(buffer);
+
+  UnmapViewOfFile(results);
+  CloseHandle(hMapping);
+
+  return (failures == 0 && parentCount == g_brokerLoadTestParents) ? 0 : 1;
 }
\ No newline at end of file